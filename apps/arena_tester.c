@@ -0,0 +1,197 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <arena.h>
+#include <executor.h>
+#include <uthread.h>
+
+#define TEST_ASSERT(assert)				\
+do {									\
+	printf("ASSERT: " #assert " ... ");	\
+	if (assert) {						\
+		printf("PASS\n");				\
+	} else	{							\
+		printf("FAIL\n");				\
+		exit(1);						\
+	}									\
+} while(0)
+
+/* Largest stack a thread may get, to tell whether memory lies in it */
+#define STACK_SPAN 32768
+
+#define ALLOCS 64
+
+static int allocs_ok;
+
+/* Allocations are aligned, disjoint, and survive context switches */
+static void thread_alloc(void *arg)
+{
+	unsigned char *ptrs[ALLOCS];
+	int i, j;
+	(void)arg;
+
+	allocs_ok = 1;
+	for (i = 0; i < ALLOCS; i++) {
+		ptrs[i] = uthread_arena_alloc(i + 1);
+		allocs_ok &= ptrs[i] != NULL;
+		allocs_ok &= (uintptr_t)ptrs[i] % _Alignof(max_align_t) == 0;
+		memset(ptrs[i], i, i + 1);
+		uthread_yield();
+	}
+	for (i = 0; i < ALLOCS; i++)
+		for (j = 0; j <= i; j++)
+			allocs_ok &= ptrs[i][j] == i;
+}
+
+void test_arena_alloc(void)
+{
+	uthread_t tid1, tid2;
+	char *big;
+
+	fprintf(stderr, "*** TEST arena_alloc ***\n");
+
+	uthread_start(UTHREAD_PREEMPT_NONE);
+	TEST_ASSERT(uthread_arena_alloc(0) == NULL);
+	TEST_ASSERT(uthread_arena_alloc(SIZE_MAX) == NULL);
+
+	/* Two threads interleaving their allocations */
+	tid1 = uthread_create(thread_alloc, NULL);
+	tid2 = uthread_create(thread_alloc, NULL);
+	uthread_join(tid1, NULL);
+	uthread_join(tid2, NULL);
+	TEST_ASSERT(allocs_ok);
+
+	/* Larger than a regular chunk */
+	big = uthread_arena_alloc(1 << 20);
+	TEST_ASSERT(big != NULL);
+	memset(big, 0xff, 1 << 20);
+	TEST_ASSERT(uthread_stop() == 0);
+}
+
+static void *first_alloc;
+
+static void thread_first_alloc(void *arg)
+{
+	(void)arg;
+
+	first_alloc = uthread_arena_alloc(128);
+}
+
+/* The memory of an exited thread goes to the next thread allocating */
+void test_arena_reset(void)
+{
+	void *previous;
+	uthread_t tid;
+	int i, reused = 1;
+
+	fprintf(stderr, "*** TEST arena_reset ***\n");
+
+	uthread_start(UTHREAD_PREEMPT_NONE);
+	tid = uthread_create(thread_first_alloc, NULL);
+	uthread_join(tid, NULL);
+	previous = first_alloc;
+	TEST_ASSERT(previous != NULL);
+
+	for (i = 0; i < 100; i++) {
+		tid = uthread_create(thread_first_alloc, NULL);
+		uthread_join(tid, NULL);
+		reused &= first_alloc == previous;
+	}
+	TEST_ASSERT(reused);
+	TEST_ASSERT(uthread_stop() == 0);
+}
+
+static void *task_allocs[4];
+
+static void task_alloc(void *arg)
+{
+	task_allocs[(intptr_t)arg] = uthread_arena_alloc(128);
+}
+
+/* Under the executor, allocations only live as long as their task */
+void test_arena_task_scope(void)
+{
+	void *mine;
+	intptr_t i;
+
+	fprintf(stderr, "*** TEST arena_task_scope ***\n");
+
+	uthread_start(UTHREAD_PREEMPT_NONE);
+	mine = uthread_arena_alloc(128);
+	TEST_ASSERT(uthread_executor_start(1, 4) == 0);
+	for (i = 0; i < 4; i++)
+		uthread_executor_submit(task_alloc, (void *)i);
+	TEST_ASSERT(uthread_executor_drain() == 0);
+
+	/* One worker: each task gets the memory of the task before it */
+	TEST_ASSERT(task_allocs[0] != NULL);
+	TEST_ASSERT(task_allocs[0] != mine);
+	TEST_ASSERT(task_allocs[1] == task_allocs[0]);
+	TEST_ASSERT(task_allocs[2] == task_allocs[0]);
+	TEST_ASSERT(task_allocs[3] == task_allocs[0]);
+
+	TEST_ASSERT(uthread_executor_shutdown() == 0);
+	TEST_ASSERT(uthread_stop() == 0);
+}
+
+static void *small_alloc, *large_alloc;
+static int small_on_stack, large_on_stack;
+
+/* Whether @ptr lies below the caller's frame, within a stack's reach */
+static int on_own_stack(void *ptr)
+{
+	char local;
+
+	return (uintptr_t)ptr < (uintptr_t)&local &&
+		(uintptr_t)&local - (uintptr_t)ptr < STACK_SPAN;
+}
+
+static void thread_place(void *arg)
+{
+	size_t reserve = (size_t)arg;
+
+	small_alloc = uthread_arena_alloc(64);
+	small_on_stack = on_own_stack(small_alloc);
+	large_alloc = uthread_arena_alloc(reserve + 1);
+	large_on_stack = on_own_stack(large_alloc);
+}
+
+/* The stack reservation serves the allocations that fit, at the stack's end */
+void test_arena_stack_reserve(void)
+{
+	uthread_t tid;
+
+	fprintf(stderr, "*** TEST arena_stack_reserve ***\n");
+
+	uthread_start(UTHREAD_PREEMPT_NONE);
+	TEST_ASSERT(uthread_arena_set_stack_reserve(UTHREAD_ARENA_STACK_RESERVE_MAX + 1) == -1);
+
+	TEST_ASSERT(uthread_arena_set_stack_reserve(4096) == 0);
+	tid = uthread_create(thread_place, (void *)4096);
+	uthread_join(tid, NULL);
+	TEST_ASSERT(small_alloc != NULL && small_on_stack);
+	TEST_ASSERT(large_alloc != NULL && !large_on_stack);
+
+	/* Shared-stack threads get no reservation */
+	tid = uthread_create_shared(thread_place, (void *)4096);
+	uthread_join(tid, NULL);
+	TEST_ASSERT(small_alloc != NULL && !small_on_stack);
+
+	TEST_ASSERT(uthread_arena_set_stack_reserve(0) == 0);
+	tid = uthread_create(thread_place, (void *)0);
+	uthread_join(tid, NULL);
+	TEST_ASSERT(small_alloc != NULL && !small_on_stack);
+	TEST_ASSERT(uthread_stop() == 0);
+}
+
+int main(void)
+{
+	test_arena_alloc();
+	test_arena_reset();
+	test_arena_task_scope();
+	test_arena_stack_reserve();
+
+	return 0;
+}
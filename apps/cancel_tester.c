@@ -0,0 +1,205 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <park.h>
+#include <sem.h>
+#include <uthread.h>
+
+#define TEST_ASSERT(assert)				\
+do {									\
+	printf("ASSERT: " #assert " ... ");	\
+	if (assert) {						\
+		printf("PASS\n");				\
+	} else	{							\
+		printf("FAIL\n");				\
+		exit(1);						\
+	}									\
+} while(0)
+
+/* Cleanup handlers record their argument, in call order */
+static int cleanups[8], ncleanups;
+static int reached;
+
+static void cleanup(void *arg)
+{
+	cleanups[ncleanups++] = (int)(long)arg;
+}
+
+static sem_t sem;
+static int word;
+static uthread_t target;
+
+static void thread_sem(void *arg)
+{
+	(void)arg;
+	uthread_cleanup_push(cleanup, (void *)1);
+	uthread_cleanup_push(cleanup, (void *)2);
+	sem_down(sem);
+	reached = 1;
+	uthread_cleanup_pop(0);
+	uthread_cleanup_pop(0);
+}
+
+static void thread_park(void *arg)
+{
+	(void)arg;
+	uthread_cleanup_push(cleanup, (void *)3);
+	uthread_park(&word, 0);
+	reached = 1;
+	uthread_cleanup_pop(0);
+}
+
+static void thread_spin(void *arg)
+{
+	(void)arg;
+	for (;;)
+		uthread_yield();
+}
+
+static void thread_join(void *arg)
+{
+	(void)arg;
+	uthread_cleanup_push(cleanup, (void *)4);
+	uthread_join(target, NULL);
+	reached = 1;
+	uthread_cleanup_pop(0);
+}
+
+static void thread_sem_normal(void *arg)
+{
+	(void)arg;
+	sem_down(sem);
+	reached = 1;
+}
+
+static void thread_pop(void *arg)
+{
+	(void)arg;
+	uthread_cleanup_push(cleanup, (void *)5);
+	uthread_cleanup_push(cleanup, (void *)6);
+	uthread_cleanup_pop(1);
+	uthread_cleanup_pop(0);
+	uthread_testcancel();
+	reached = 1;
+}
+
+static void reset(void)
+{
+	ncleanups = 0;
+	reached = 0;
+}
+
+/* Invalid targets */
+void test_cancel_args(void)
+{
+	uthread_t tid;
+
+	fprintf(stderr, "*** TEST cancel_args ***\n");
+
+	uthread_start(UTHREAD_PREEMPT_NONE);
+	reset();
+	TEST_ASSERT(uthread_cancel(0) == -1);
+	tid = uthread_create(thread_pop, NULL);
+	uthread_join(tid, NULL);
+	TEST_ASSERT(uthread_cancel(tid) == -1);
+	uthread_stop();
+}
+
+/* Handlers pushed and popped without cancellation */
+void test_cleanup_pop(void)
+{
+	uthread_t tid;
+
+	fprintf(stderr, "*** TEST cleanup_pop ***\n");
+
+	uthread_start(UTHREAD_PREEMPT_NONE);
+	reset();
+	tid = uthread_create(thread_pop, NULL);
+	uthread_join(tid, NULL);
+	TEST_ASSERT(reached);
+	TEST_ASSERT(ncleanups == 1 && cleanups[0] == 6);
+	uthread_stop();
+}
+
+/* Cancelling a thread blocked on a semaphore */
+void test_cancel_sem(void)
+{
+	uthread_t victim, other;
+
+	fprintf(stderr, "*** TEST cancel_sem ***\n");
+
+	uthread_start(UTHREAD_PREEMPT_NONE);
+	reset();
+	sem = sem_create(0);
+	victim = uthread_create(thread_sem, NULL);
+	other = uthread_create(thread_sem_normal, NULL);
+	uthread_yield();
+
+	TEST_ASSERT(uthread_cancel(victim) == 0);
+	TEST_ASSERT(uthread_join(victim, NULL) == 0);
+	TEST_ASSERT(!reached);
+	TEST_ASSERT(ncleanups == 2 && cleanups[0] == 2 && cleanups[1] == 1);
+
+	/* The cancelled waiter left the queue: the release goes to the other */
+	sem_up(sem);
+	TEST_ASSERT(uthread_join(other, NULL) == 0);
+	TEST_ASSERT(reached);
+	TEST_ASSERT(sem_destroy(sem) == 0);
+	uthread_stop();
+}
+
+/* Cancelling a thread parked on an address */
+void test_cancel_park(void)
+{
+	uthread_t victim;
+
+	fprintf(stderr, "*** TEST cancel_park ***\n");
+
+	uthread_start(UTHREAD_PREEMPT_NONE);
+	reset();
+	word = 0;
+	victim = uthread_create(thread_park, NULL);
+	uthread_yield();
+
+	TEST_ASSERT(uthread_cancel(victim) == 0);
+	TEST_ASSERT(uthread_join(victim, NULL) == 0);
+	TEST_ASSERT(!reached);
+	TEST_ASSERT(ncleanups == 1 && cleanups[0] == 3);
+	TEST_ASSERT(uthread_unpark(&word, 1) == 0);
+	uthread_stop();
+}
+
+/* Cancelling a thread blocked in a join, then a yielding thread */
+void test_cancel_join(void)
+{
+	uthread_t victim;
+
+	fprintf(stderr, "*** TEST cancel_join ***\n");
+
+	uthread_start(UTHREAD_PREEMPT_NONE);
+	reset();
+	target = uthread_create(thread_spin, NULL);
+	victim = uthread_create(thread_join, NULL);
+	uthread_yield();
+
+	TEST_ASSERT(uthread_cancel(victim) == 0);
+	TEST_ASSERT(uthread_join(victim, NULL) == 0);
+	TEST_ASSERT(!reached);
+	TEST_ASSERT(ncleanups == 1 && cleanups[0] == 4);
+
+	/* The target can be joined again, once it is cancelled in turn */
+	TEST_ASSERT(uthread_cancel(target) == 0);
+	TEST_ASSERT(uthread_join(target, NULL) == 0);
+	uthread_stop();
+}
+
+int main(void)
+{
+	test_cancel_args();
+	test_cleanup_pop();
+	test_cancel_sem();
+	test_cancel_park();
+	test_cancel_join();
+
+	return 0;
+}
@@ -0,0 +1,212 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <uthread.h>
+
+#define TEST_ASSERT(assert)				\
+do {									\
+	printf("ASSERT: " #assert " ... ");	\
+	if (assert) {						\
+		printf("PASS\n");				\
+	} else	{							\
+		printf("FAIL\n");				\
+		exit(1);						\
+	}									\
+} while(0)
+
+#define MAX_RUNS 32
+
+/* Order in which the threads ran */
+static int runs[MAX_RUNS], nruns;
+
+static void thread_log(void *arg)
+{
+	runs[nruns++] = (int)(intptr_t)arg;
+}
+
+static int runs_are(const int *expected, int count)
+{
+	int i;
+
+	if (nruns != count)
+		return 0;
+	for (i = 0; i < count; i++)
+		if (runs[i] != expected[i])
+			return 0;
+	return 1;
+}
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+/* Deadlines far enough in the future not to be missed */
+static uint64_t future(int rank)
+{
+	static uint64_t base;
+
+	if (!base)
+		base = now_ns() + 3600 * 1000000000ull;
+	return base + (uint64_t)rank * 1000;
+}
+
+/*
+ * Start the library with no deadline streak pending: yielding with no other
+ * thread ready dispatches from the ready queue, which resets the streak
+ */
+static void start(void)
+{
+	uthread_start(UTHREAD_PREEMPT_NONE);
+	uthread_yield();
+	nruns = 0;
+}
+
+/* Earliest deadline first, whatever the creation order */
+void test_deadline_order(void)
+{
+	int ranks[] = { 3, 0, 4, 1, 2 };
+	int expected[] = { 0, 1, 2, 3, 4 };
+	uthread_t tids[5];
+	int i;
+
+	fprintf(stderr, "*** TEST deadline_order ***\n");
+
+	start();
+	for (i = 0; i < 5; i++) {
+		tids[i] = uthread_create(thread_log, (void *)(intptr_t)ranks[i]);
+		TEST_ASSERT(uthread_set_deadline(tids[i], future(ranks[i])) == 0);
+	}
+	uthread_yield();
+	TEST_ASSERT(runs_are(expected, 5));
+	for (i = 0; i < 5; i++)
+		uthread_join(tids[i], NULL);
+	TEST_ASSERT(uthread_stop() == 0);
+}
+
+/*
+ * Deadline threads, tied or not, go before the ready queue, which keeps its
+ * FIFO order. A thread whose deadline is cleared goes back to the ready queue.
+ */
+void test_deadline_fallback(void)
+{
+	uthread_t tids[6];
+	int i, tied_first;
+
+	fprintf(stderr, "*** TEST deadline_fallback ***\n");
+
+	start();
+	for (i = 0; i < 6; i++)
+		tids[i] = uthread_create(thread_log, (void *)(intptr_t)i);
+	TEST_ASSERT(uthread_set_deadline(tids[4], future(1)) == 0);
+	TEST_ASSERT(uthread_set_deadline(tids[2], future(1)) == 0);
+	TEST_ASSERT(uthread_set_deadline(tids[5], future(0)) == 0);
+	TEST_ASSERT(uthread_set_deadline(tids[0], future(2)) == 0);
+	TEST_ASSERT(uthread_set_deadline(tids[0], 0) == 0);
+	uthread_yield();
+
+	TEST_ASSERT(nruns == 6);
+	TEST_ASSERT(runs[0] == 5);
+	tied_first = runs[1];
+	TEST_ASSERT((tied_first == 2 && runs[2] == 4) ||
+		    (tied_first == 4 && runs[2] == 2));
+	TEST_ASSERT(runs[3] == 1 && runs[4] == 3 && runs[5] == 0);
+	for (i = 0; i < 6; i++)
+		uthread_join(tids[i], NULL);
+	TEST_ASSERT(uthread_stop() == 0);
+}
+
+/* The ready queue gets a turn after every 8 consecutive deadline threads */
+void test_deadline_streak(void)
+{
+	int expected[] = { 0, 1, 2, 3, 4, 5, 6, 7, 100, 8, 9, 101 };
+	uthread_t tids[12];
+	int i;
+
+	fprintf(stderr, "*** TEST deadline_streak ***\n");
+
+	start();
+	tids[10] = uthread_create(thread_log, (void *)100);
+	tids[11] = uthread_create(thread_log, (void *)101);
+	for (i = 0; i < 10; i++) {
+		tids[i] = uthread_create(thread_log, (void *)(intptr_t)i);
+		uthread_set_deadline(tids[i], future(i));
+	}
+	uthread_yield();
+	TEST_ASSERT(runs_are(expected, 12));
+	for (i = 0; i < 12; i++)
+		uthread_join(tids[i], NULL);
+	TEST_ASSERT(uthread_stop() == 0);
+}
+
+static void thread_yield_log(void *arg)
+{
+	int i;
+
+	for (i = 0; i < 10; i++) {
+		runs[nruns++] = (int)(intptr_t)arg;
+		uthread_yield();
+	}
+}
+
+/* A yielding deadline thread stays in the deadline lane */
+void test_deadline_yield(void)
+{
+	int expected[] = { 1, 1, 1, 1, 1, 1, 1, 1, 2, 1, 1 };
+	uthread_t tid1, tid2;
+
+	fprintf(stderr, "*** TEST deadline_yield ***\n");
+
+	start();
+	tid1 = uthread_create(thread_yield_log, (void *)1);
+	tid2 = uthread_create(thread_log, (void *)2);
+	uthread_set_deadline(tid1, future(0));
+	uthread_yield();
+	TEST_ASSERT(runs_are(expected, 11));
+	uthread_join(tid1, NULL);
+	uthread_join(tid2, NULL);
+	TEST_ASSERT(uthread_stop() == 0);
+}
+
+/* Dispatches are counted, and each missed deadline once */
+void test_deadline_stats(void)
+{
+	struct uthread_deadline_stats before, after;
+	uthread_t tid1, tid2;
+
+	fprintf(stderr, "*** TEST deadline_stats ***\n");
+
+	start();
+	uthread_get_deadline_stats(&before);
+	tid1 = uthread_create(thread_yield_log, (void *)1);
+	tid2 = uthread_create(thread_log, (void *)2);
+	uthread_set_deadline(tid1, 1);
+	uthread_set_deadline(tid2, future(0));
+	uthread_yield();
+	uthread_join(tid1, NULL);
+	uthread_join(tid2, NULL);
+	uthread_get_deadline_stats(&after);
+
+	/* The missed thread runs first and after each of its 10 yields */
+	TEST_ASSERT(after.dispatched - before.dispatched == 12);
+	TEST_ASSERT(after.missed - before.missed == 1);
+
+	TEST_ASSERT(uthread_set_deadline(tid1, future(0)) == -1);
+	TEST_ASSERT(uthread_stop() == 0);
+}
+
+int main(void)
+{
+	test_deadline_order();
+	test_deadline_fallback();
+	test_deadline_streak();
+	test_deadline_yield();
+	test_deadline_stats();
+
+	return 0;
+}
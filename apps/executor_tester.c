@@ -0,0 +1,167 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <executor.h>
+#include <park.h>
+#include <uthread.h>
+
+#define TEST_ASSERT(assert)				\
+do {									\
+	printf("ASSERT: " #assert " ... ");	\
+	if (assert) {						\
+		printf("PASS\n");				\
+	} else	{							\
+		printf("FAIL\n");				\
+		exit(1);						\
+	}									\
+} while(0)
+
+#define TASKS 1000
+
+static int done[TASKS], ndone;
+
+static void task(void *arg)
+{
+	int i = (int)(long)arg;
+
+	if (i % 3 == 0)
+		uthread_yield();
+	done[i]++;
+	ndone++;
+}
+
+static int all_done_once(void)
+{
+	int i;
+
+	for (i = 0; i < TASKS; i++)
+		if (done[i] != 1)
+			return 0;
+	return 1;
+}
+
+static void reset(void)
+{
+	int i;
+
+	for (i = 0; i < TASKS; i++)
+		done[i] = 0;
+	ndone = 0;
+}
+
+/* Invalid arguments and use outside of start/shutdown */
+void test_executor_args(void)
+{
+	fprintf(stderr, "*** TEST executor_args ***\n");
+
+	uthread_start(UTHREAD_PREEMPT_NONE);
+	TEST_ASSERT(uthread_executor_submit(task, NULL) == -1);
+	TEST_ASSERT(uthread_executor_drain() == -1);
+	TEST_ASSERT(uthread_executor_shutdown() == -1);
+	TEST_ASSERT(uthread_executor_start(0, 4) == -1);
+	TEST_ASSERT(uthread_executor_start(4, 0) == -1);
+	TEST_ASSERT(uthread_executor_start(2, 4) == 0);
+	TEST_ASSERT(uthread_executor_start(2, 4) == -1);
+	TEST_ASSERT(uthread_executor_submit(NULL, NULL) == -1);
+	TEST_ASSERT(uthread_executor_shutdown() == 0);
+	uthread_stop();
+}
+
+/* Drain waits for every task, more numerous than the queue can hold */
+void test_executor_drain(void)
+{
+	int i, ok = 1;
+
+	fprintf(stderr, "*** TEST executor_drain ***\n");
+
+	uthread_start(UTHREAD_PREEMPT_NONE);
+	reset();
+	TEST_ASSERT(uthread_executor_start(4, 8) == 0);
+	for (i = 0; i < TASKS; i++)
+		ok &= uthread_executor_submit(task, (void *)(long)i) == 0;
+	TEST_ASSERT(ok);
+	TEST_ASSERT(uthread_executor_drain() == 0);
+	TEST_ASSERT(ndone == TASKS);
+	TEST_ASSERT(all_done_once());
+
+	/* Draining an idle executor returns right away */
+	TEST_ASSERT(uthread_executor_drain() == 0);
+	TEST_ASSERT(uthread_executor_shutdown() == 0);
+	uthread_stop();
+}
+
+/* Shutdown runs the queued tasks, then refuses new ones */
+void test_executor_shutdown(void)
+{
+	int i;
+
+	fprintf(stderr, "*** TEST executor_shutdown ***\n");
+
+	uthread_start(UTHREAD_PREEMPT_NONE);
+	reset();
+	TEST_ASSERT(uthread_executor_start(2, TASKS) == 0);
+	for (i = 0; i < TASKS; i++)
+		uthread_executor_submit(task, (void *)(long)i);
+	TEST_ASSERT(ndone < TASKS);
+	TEST_ASSERT(uthread_executor_shutdown() == 0);
+	TEST_ASSERT(ndone == TASKS);
+	TEST_ASSERT(all_done_once());
+	TEST_ASSERT(uthread_executor_submit(task, NULL) == -1);
+
+	/* The executor can be started again */
+	reset();
+	TEST_ASSERT(uthread_executor_start(3, 2) == 0);
+	for (i = 0; i < TASKS; i++)
+		uthread_executor_submit(task, (void *)(long)i);
+	TEST_ASSERT(uthread_executor_shutdown() == 0);
+	TEST_ASSERT(all_done_once());
+	TEST_ASSERT(uthread_stop() == 0);
+}
+
+static uthread_t blocked_worker;
+static int word;
+
+/* Wait forever, recording the worker running the task */
+static void task_block(void *arg)
+{
+	(void)arg;
+
+	blocked_worker = uthread_self();
+	for (;;)
+		uthread_park(&word, 0);
+}
+
+/* A worker cancelled in the middle of a task does not stall drain */
+void test_executor_cancel(void)
+{
+	int i;
+
+	fprintf(stderr, "*** TEST executor_cancel ***\n");
+
+	uthread_start(UTHREAD_PREEMPT_NONE);
+	reset();
+	blocked_worker = 0;
+	TEST_ASSERT(uthread_executor_start(2, 4) == 0);
+	TEST_ASSERT(uthread_executor_submit(task_block, NULL) == 0);
+	while (!blocked_worker)
+		uthread_yield();
+	TEST_ASSERT(uthread_cancel(blocked_worker) == 0);
+
+	/* The worker left still runs the next tasks */
+	for (i = 0; i < TASKS; i++)
+		uthread_executor_submit(task, (void *)(long)i);
+	TEST_ASSERT(uthread_executor_drain() == 0);
+	TEST_ASSERT(all_done_once());
+	TEST_ASSERT(uthread_executor_shutdown() == 0);
+	TEST_ASSERT(uthread_stop() == 0);
+}
+
+int main(void)
+{
+	test_executor_args();
+	test_executor_drain();
+	test_executor_shutdown();
+	test_executor_cancel();
+
+	return 0;
+}
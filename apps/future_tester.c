@@ -0,0 +1,237 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <executor.h>
+#include <future.h>
+#include <sem.h>
+#include <uthread.h>
+
+#define TEST_ASSERT(assert)				\
+do {									\
+	printf("ASSERT: " #assert " ... ");	\
+	if (assert) {						\
+		printf("PASS\n");				\
+	} else	{							\
+		printf("FAIL\n");				\
+		exit(1);						\
+	}									\
+} while(0)
+
+static void *square(void *arg)
+{
+	intptr_t x = (intptr_t)arg;
+
+	uthread_yield();
+	return (void *)(x * x);
+}
+
+static void *add(void *result, void *arg)
+{
+	return (void *)((intptr_t)result + (intptr_t)arg);
+}
+
+static void *twice(void *result, void *arg)
+{
+	(void)arg;
+
+	return (void *)((intptr_t)result * 2);
+}
+
+/* Results come back from threads or from the executor alike */
+static void check_async(void)
+{
+	future_t futures[8];
+	void *result;
+	int i, ok = 1;
+
+	for (i = 0; i < 8; i++)
+		futures[i] = uthread_async(square, (void *)(intptr_t)i);
+	for (i = 0; i < 8; i++) {
+		ok &= futures[i] != NULL;
+		ok &= future_get(futures[i], &result) == 0 && (intptr_t)result == i * i;
+		ok &= future_release(futures[i]) == 0;
+	}
+	TEST_ASSERT(ok);
+}
+
+void test_future_async(void)
+{
+	fprintf(stderr, "*** TEST future_async ***\n");
+
+	uthread_start(UTHREAD_PREEMPT_NONE);
+	TEST_ASSERT(uthread_async(NULL, NULL) == NULL);
+	TEST_ASSERT(future_get(NULL, NULL) == -1);
+	check_async();
+
+	TEST_ASSERT(uthread_executor_start(2, 4) == 0);
+	check_async();
+	TEST_ASSERT(uthread_executor_shutdown() == 0);
+	TEST_ASSERT(uthread_stop() == 0);
+}
+
+static uthread_t then_runner;
+
+/* Like add(), recording the thread running the continuation */
+static void *add_self(void *result, void *arg)
+{
+	then_runner = uthread_self();
+	return add(result, arg);
+}
+
+/* Continuations chain, whether attached before or after completion */
+void test_future_then(void)
+{
+	future_t f, g, h;
+	void *result;
+
+	fprintf(stderr, "*** TEST future_then ***\n");
+
+	uthread_start(UTHREAD_PREEMPT_NONE);
+
+	/* Attached while pending: (3 * 3 + 1) * 2 */
+	f = uthread_async(square, (void *)3);
+	g = future_then(f, add, (void *)1);
+	h = future_then(g, twice, NULL);
+	TEST_ASSERT(g != NULL && h != NULL);
+	TEST_ASSERT(future_then(f, add, NULL) == NULL);
+	TEST_ASSERT(future_get(h, &result) == 0 && (intptr_t)result == 20);
+	TEST_ASSERT(future_get(g, &result) == 0 && (intptr_t)result == 10);
+	future_release(f);
+	future_release(g);
+	future_release(h);
+
+	/* Attached once done: runs right away, in the calling thread */
+	f = uthread_async(square, (void *)4);
+	future_get(f, NULL);
+	then_runner = (uthread_t)-1;
+	g = future_then(f, add_self, (void *)2);
+	TEST_ASSERT(then_runner == uthread_self());
+	TEST_ASSERT(future_get(g, &result) == 0 && (intptr_t)result == 18);
+	TEST_ASSERT(future_then(NULL, add, NULL) == NULL);
+	TEST_ASSERT(future_then(f, NULL, NULL) == NULL);
+	future_release(f);
+	future_release(g);
+
+	TEST_ASSERT(uthread_stop() == 0);
+}
+
+static sem_t gates[3];
+
+/* Return @arg once its gate opens */
+static void *gated(void *arg)
+{
+	sem_down(gates[(intptr_t)arg]);
+	return arg;
+}
+
+/* wait_any returns the future done, wait_all waits for the rest */
+void test_future_wait(void)
+{
+	future_t futures[3];
+	int i;
+
+	fprintf(stderr, "*** TEST future_wait ***\n");
+
+	uthread_start(UTHREAD_PREEMPT_NONE);
+	for (i = 0; i < 3; i++) {
+		gates[i] = sem_create(0);
+		futures[i] = uthread_async(gated, (void *)(intptr_t)i);
+	}
+
+	TEST_ASSERT(future_wait_any(NULL, 3) == -1);
+	TEST_ASSERT(future_wait_any(futures, 0) == -1);
+	TEST_ASSERT(future_wait_all(NULL, 3) == -1);
+	TEST_ASSERT(future_wait_all(futures, -1) == -1);
+	TEST_ASSERT(future_release(futures[1]) == -1);
+
+	sem_up(gates[1]);
+	TEST_ASSERT(future_wait_any(futures, 3) == 1);
+	sem_up(gates[2]);
+	sem_up(gates[0]);
+	TEST_ASSERT(future_wait_all(futures, 3) == 0);
+	TEST_ASSERT(future_wait_any(futures, 3) == 0);
+
+	for (i = 0; i < 3; i++) {
+		TEST_ASSERT(future_release(futures[i]) == 0);
+		sem_destroy(gates[i]);
+	}
+	TEST_ASSERT(uthread_stop() == 0);
+}
+
+/* Released futures are reused, so that steady state allocates nothing */
+void test_future_pool(void)
+{
+	future_t f, g;
+	int i, reused = 1;
+
+	fprintf(stderr, "*** TEST future_pool ***\n");
+
+	uthread_start(UTHREAD_PREEMPT_NONE);
+	TEST_ASSERT(future_release(NULL) == -1);
+	f = uthread_async(square, (void *)2);
+	future_get(f, NULL);
+	future_release(f);
+	for (i = 0; i < 1000; i++) {
+		g = uthread_async(square, (void *)2);
+		reused &= g == f;
+		future_get(g, NULL);
+		future_release(g);
+	}
+	TEST_ASSERT(reused);
+	TEST_ASSERT(uthread_stop() == 0);
+}
+
+#define FANOUT_TASKS 4
+
+static int fanout_sum;
+
+/* Wait for children from a task, while every worker does the same */
+static void task_fanout(void *arg)
+{
+	future_t children[2];
+	void *result;
+	int i;
+	(void)arg;
+
+	for (i = 0; i < 2; i++)
+		children[i] = uthread_async(square, (void *)(intptr_t)(i + 2));
+	for (i = 0; i < 2; i++) {
+		future_get(children[i], &result);
+		fanout_sum += (intptr_t)result;
+		future_release(children[i]);
+	}
+}
+
+/* Tasks can wait for futures they create without deadlocking the workers */
+void test_future_fanout(void)
+{
+	int i;
+
+	fprintf(stderr, "*** TEST future_fanout ***\n");
+
+	uthread_start(UTHREAD_PREEMPT_NONE);
+	fanout_sum = 0;
+	TEST_ASSERT(uthread_executor_start(2, 2) == 0);
+	for (i = 0; i < FANOUT_TASKS; i++)
+		uthread_executor_submit(task_fanout, NULL);
+	TEST_ASSERT(uthread_executor_drain() == 0);
+	TEST_ASSERT(fanout_sum == FANOUT_TASKS * (4 + 9));
+	TEST_ASSERT(uthread_executor_shutdown() == 0);
+	TEST_ASSERT(uthread_stop() == 0);
+}
+
+int main(void)
+{
+	// A deadlock shows up as a hang
+	alarm(30);
+
+	test_future_async();
+	test_future_then();
+	test_future_wait();
+	test_future_pool();
+	test_future_fanout();
+
+	return 0;
+}
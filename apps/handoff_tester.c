@@ -0,0 +1,183 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <sem.h>
+#include <uthread.h>
+
+#define TEST_ASSERT(assert)				\
+do {									\
+	printf("ASSERT: " #assert " ... ");	\
+	if (assert) {						\
+		printf("PASS\n");				\
+	} else	{							\
+		printf("FAIL\n");				\
+		exit(1);						\
+	}									\
+} while(0)
+
+#define THREADS 8
+
+/* Order in which the threads ran */
+static int runs[THREADS + 1], nruns;
+
+static void thread_log(void *arg)
+{
+	runs[nruns++] = (int)(intptr_t)arg;
+}
+
+static int runs_are(const int *expected, int count)
+{
+	int i;
+
+	if (nruns != count)
+		return 0;
+	for (i = 0; i < count; i++)
+		if (runs[i] != expected[i])
+			return 0;
+	return 1;
+}
+
+/* The target runs next, then the others in their usual order */
+void test_yield_to_order(void)
+{
+	int expected[THREADS] = { 5, 0, 1, 2, 3, 4, 6, 7 };
+	uthread_t tids[THREADS];
+	int i;
+
+	fprintf(stderr, "*** TEST yield_to_order ***\n");
+
+	uthread_start(UTHREAD_PREEMPT_NONE);
+	nruns = 0;
+	for (i = 0; i < THREADS; i++)
+		tids[i] = uthread_create(thread_log, (void *)(intptr_t)i);
+	TEST_ASSERT(uthread_yield_to(tids[5]) == 0);
+	TEST_ASSERT(runs_are(expected, THREADS));
+	for (i = 0; i < THREADS; i++)
+		uthread_join(tids[i], NULL);
+	TEST_ASSERT(uthread_stop() == 0);
+}
+
+/* Targets moved by uthread_set_deadline(), or in the deadline lane */
+void test_yield_to_lanes(void)
+{
+	int moved[THREADS] = { 7, 0, 1, 2, 4, 5, 6, 3 };
+	int lane[THREADS] = { 5, 3, 0, 1, 2, 4, 6, 7 };
+	uthread_t tids[THREADS];
+	int i;
+
+	fprintf(stderr, "*** TEST yield_to_lanes ***\n");
+
+	uthread_start(UTHREAD_PREEMPT_NONE);
+
+	/* Back in the ready queue after a round in the deadline lane */
+	nruns = 0;
+	for (i = 0; i < THREADS; i++)
+		tids[i] = uthread_create(thread_log, (void *)(intptr_t)i);
+	TEST_ASSERT(uthread_set_deadline(tids[3], UINT64_MAX) == 0);
+	TEST_ASSERT(uthread_set_deadline(tids[3], 0) == 0);
+	TEST_ASSERT(uthread_yield_to(tids[7]) == 0);
+	TEST_ASSERT(runs_are(moved, THREADS));
+	for (i = 0; i < THREADS; i++)
+		uthread_join(tids[i], NULL);
+
+	/* Deadline threads still go first after the target */
+	nruns = 0;
+	for (i = 0; i < THREADS; i++)
+		tids[i] = uthread_create(thread_log, (void *)(intptr_t)i);
+	TEST_ASSERT(uthread_set_deadline(tids[3], UINT64_MAX) == 0);
+	TEST_ASSERT(uthread_yield_to(tids[5]) == 0);
+	TEST_ASSERT(runs_are(lane, THREADS));
+	for (i = 0; i < THREADS; i++)
+		uthread_join(tids[i], NULL);
+
+	TEST_ASSERT(uthread_stop() == 0);
+}
+
+static sem_t sem;
+
+static void thread_wait(void *arg)
+{
+	sem_down(sem);
+	runs[nruns++] = (int)(intptr_t)arg;
+}
+
+/* Only ready threads can be yielded to */
+void test_yield_to_invalid(void)
+{
+	uthread_t waiter, done;
+
+	fprintf(stderr, "*** TEST yield_to_invalid ***\n");
+
+	uthread_start(UTHREAD_PREEMPT_NONE);
+	sem = sem_create(0);
+	nruns = 0;
+	waiter = uthread_create(thread_wait, (void *)1);
+	done = uthread_create(thread_log, (void *)2);
+	uthread_yield();
+
+	TEST_ASSERT(uthread_yield_to(uthread_self()) == -1);
+	TEST_ASSERT(uthread_yield_to(waiter) == -1);
+	TEST_ASSERT(uthread_yield_to(done) == -1);
+	TEST_ASSERT(uthread_join(done, NULL) == 0);
+	TEST_ASSERT(uthread_yield_to(done) == -1);
+
+	sem_up(sem);
+	TEST_ASSERT(uthread_join(waiter, NULL) == 0);
+	TEST_ASSERT(sem_destroy(sem) == 0);
+	TEST_ASSERT(uthread_stop() == 0);
+}
+
+/*
+ * Release @sem while THREADS other threads are ready, the waiter being logged
+ * as THREADS
+ */
+static void release_with_ready_threads(int handoff)
+{
+	uthread_t waiter, tids[THREADS];
+	int i;
+
+	uthread_start(UTHREAD_PREEMPT_NONE);
+	sem = sem_create(0);
+	nruns = 0;
+	waiter = uthread_create(thread_wait, (void *)THREADS);
+	uthread_yield();
+	for (i = 0; i < THREADS; i++)
+		tids[i] = uthread_create(thread_log, (void *)(intptr_t)i);
+
+	if (handoff)
+		sem_up_handoff(sem);
+	else
+		sem_up(sem);
+
+	uthread_join(waiter, NULL);
+	for (i = 0; i < THREADS; i++)
+		uthread_join(tids[i], NULL);
+	sem_destroy(sem);
+	uthread_stop();
+}
+
+/* The woken waiter runs before the threads already ready */
+void test_sem_up_handoff(void)
+{
+	int handoff[] = { THREADS, 0, 1, 2, 3, 4, 5, 6, 7 };
+	int plain[] = { 0, 1, 2, 3, 4, 5, 6, 7, THREADS };
+
+	fprintf(stderr, "*** TEST sem_up_handoff ***\n");
+
+	release_with_ready_threads(1);
+	TEST_ASSERT(runs_are(handoff, THREADS + 1));
+
+	release_with_ready_threads(0);
+	TEST_ASSERT(runs_are(plain, THREADS + 1));
+}
+
+int main(void)
+{
+	test_yield_to_order();
+	test_yield_to_lanes();
+	test_yield_to_invalid();
+	test_sem_up_handoff();
+
+	return 0;
+}
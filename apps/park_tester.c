@@ -0,0 +1,112 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <park.h>
+#include <uthread.h>
+
+#define TEST_ASSERT(assert)				\
+do {									\
+	printf("ASSERT: " #assert " ... ");	\
+	if (assert) {						\
+		printf("PASS\n");				\
+	} else	{							\
+		printf("FAIL\n");				\
+		exit(1);						\
+	}									\
+} while(0)
+
+#define WAITERS 4
+
+static int word;
+static int words[512];
+static int order[WAITERS], woken;
+
+static void thread_park(void *arg)
+{
+	if (uthread_park(&word, 0) == 0)
+		order[woken++] = (int)(long)arg;
+}
+
+static void thread_park_other(void *arg)
+{
+	int *addr = arg;
+
+	if (uthread_park(addr, 0) == 0)
+		woken++;
+}
+
+/* Invalid arguments and value mismatch */
+void test_park_args(void)
+{
+	fprintf(stderr, "*** TEST park_args ***\n");
+
+	uthread_start(UTHREAD_PREEMPT_NONE);
+	word = 1;
+	TEST_ASSERT(uthread_park(NULL, 0) == -1);
+	TEST_ASSERT(uthread_park(&word, 0) == -1);
+	TEST_ASSERT(uthread_unpark(NULL, 1) == -1);
+	TEST_ASSERT(uthread_unpark(&word, -1) == -1);
+	TEST_ASSERT(uthread_unpark(&word, 1) == 0);
+	uthread_stop();
+}
+
+/* Waiters are woken oldest first, and no more than asked for */
+void test_park_fifo(void)
+{
+	uthread_t tids[WAITERS];
+	int i;
+
+	fprintf(stderr, "*** TEST park_fifo ***\n");
+
+	uthread_start(UTHREAD_PREEMPT_NONE);
+	word = 0;
+	woken = 0;
+	for (i = 0; i < WAITERS; i++)
+		tids[i] = uthread_create(thread_park, (void *)(long)i);
+	uthread_yield();
+
+	TEST_ASSERT(uthread_unpark(&word, 1) == 1);
+	uthread_yield();
+	TEST_ASSERT(woken == 1);
+	TEST_ASSERT(uthread_unpark(&word, WAITERS) == WAITERS - 1);
+	for (i = 0; i < WAITERS; i++)
+		uthread_join(tids[i], NULL);
+	TEST_ASSERT(woken == WAITERS);
+	TEST_ASSERT(order[0] == 0 && order[1] == 1 && order[2] == 2 && order[3] == 3);
+	uthread_stop();
+}
+
+/* Only the waiters of the given address are woken, whatever their bucket */
+void test_park_addr(void)
+{
+	uthread_t tids[512];
+	int i;
+
+	fprintf(stderr, "*** TEST park_addr ***\n");
+
+	uthread_start(UTHREAD_PREEMPT_NONE);
+	woken = 0;
+	for (i = 0; i < 512; i++)
+		tids[i] = uthread_create(thread_park_other, &words[i]);
+	uthread_yield();
+
+	TEST_ASSERT(uthread_unpark(&words[7], 512) == 1);
+	uthread_yield();
+	TEST_ASSERT(woken == 1);
+
+	for (i = 0; i < 512; i++)
+		uthread_unpark(&words[i], 1);
+	for (i = 0; i < 512; i++)
+		uthread_join(tids[i], NULL);
+	TEST_ASSERT(woken == 512);
+	uthread_stop();
+}
+
+int main(void)
+{
+	test_park_args();
+	test_park_fifo();
+	test_park_addr();
+
+	return 0;
+}
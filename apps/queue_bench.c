@@ -0,0 +1,86 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <queue.h>
+#include <typed_queue.h>
+
+/*
+ * Compare the out-of-line queue_t API against a queue generated with
+ * DEFINE_QUEUE(), on the enqueue/dequeue pattern of a scheduler ready queue:
+ * a queue holding a fixed number of items, where each dequeued item is
+ * enqueued back right away.
+ */
+
+DEFINE_QUEUE(int_queue, int)
+
+#define ITEMS	64
+#define ROUNDS	10000000
+
+static double now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void bench_queue_t(void)
+{
+	static int data[ITEMS];
+	long sum = 0;
+	queue_t q;
+	int *ptr;
+	double start;
+	int i;
+
+	q = queue_create();
+	for (i = 0; i < ITEMS; i++) {
+		data[i] = i;
+		queue_enqueue(q, &data[i]);
+	}
+
+	start = now_ns();
+	for (i = 0; i < ROUNDS; i++) {
+		queue_dequeue(q, (void**)&ptr);
+		sum += *ptr;
+		queue_enqueue(q, ptr);
+	}
+	printf("queue_t:      %6.2f ns/op (checksum %ld)\n",
+	       (now_ns() - start) / ROUNDS, sum);
+
+	while (queue_dequeue(q, (void**)&ptr) == 0)
+		;
+	queue_destroy(q);
+}
+
+static void bench_typed_queue(void)
+{
+	struct int_queue q;
+	long sum = 0;
+	double start;
+	int i, item = 0;
+
+	int_queue_init(&q);
+	for (i = 0; i < ITEMS; i++)
+		int_queue_enqueue(&q, i);
+
+	start = now_ns();
+	for (i = 0; i < ROUNDS; i++) {
+		int_queue_dequeue(&q, &item);
+		sum += item;
+		int_queue_enqueue(&q, item);
+	}
+	printf("DEFINE_QUEUE: %6.2f ns/op (checksum %ld)\n",
+	       (now_ns() - start) / ROUNDS, sum);
+
+	int_queue_fini(&q);
+}
+
+int main(void)
+{
+	bench_queue_t();
+	bench_typed_queue();
+
+	return 0;
+}
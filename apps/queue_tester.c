@@ -3,6 +3,9 @@
 #include <stdlib.h>
 
 #include <queue.h>
+#include <typed_queue.h>
+
+DEFINE_QUEUE(int_queue, int)
 
 #define TEST_ASSERT(assert)				\
 do {									\
@@ -37,10 +40,196 @@ void test_queue_simple(void)
 	TEST_ASSERT(ptr == &data);
 }
 
+/* Enqueue/Dequeue batch */
+void test_queue_batch(void)
+{
+	int data[] = {1, 2, 3, 4, 5};
+	void *in[5], *out[5];
+	int *ptr, i;
+	queue_t q;
+
+	fprintf(stderr, "*** TEST queue_batch ***\n");
+
+	for (i = 0; i < 5; i++)
+		in[i] = &data[i];
+
+	q = queue_create();
+	queue_enqueue(q, &data[0]);
+	TEST_ASSERT(queue_enqueue_batch(q, &in[1], 4) == 0);
+	TEST_ASSERT(queue_length(q) == 5);
+	TEST_ASSERT(queue_dequeue_batch(q, out, 3) == 3);
+	TEST_ASSERT(out[0] == &data[0] && out[1] == &data[1] && out[2] == &data[2]);
+	TEST_ASSERT(queue_dequeue_batch(q, out, 5) == 2);
+	TEST_ASSERT(out[0] == &data[3] && out[1] == &data[4]);
+	TEST_ASSERT(queue_length(q) == 0);
+	TEST_ASSERT(queue_dequeue(q, (void**)&ptr) == -1);
+
+	/* A NULL item rejects the whole batch */
+	in[2] = NULL;
+	TEST_ASSERT(queue_enqueue_batch(q, in, 5) == -1);
+	TEST_ASSERT(queue_length(q) == 0);
+}
+
+/* Splice */
+void test_queue_splice(void)
+{
+	int data[] = {1, 2, 3, 4};
+	int *ptr, i;
+	queue_t q1, q2;
+
+	fprintf(stderr, "*** TEST queue_splice ***\n");
+
+	q1 = queue_create();
+	q2 = queue_create();
+	queue_enqueue(q1, &data[0]);
+	queue_enqueue(q2, &data[1]);
+	queue_enqueue(q2, &data[2]);
+	TEST_ASSERT(queue_splice(q1, q2) == 0);
+	TEST_ASSERT(queue_length(q1) == 3);
+	TEST_ASSERT(queue_length(q2) == 0);
+	TEST_ASSERT(queue_splice(q1, q1) == -1);
+
+	/* The source queue is still usable once emptied */
+	queue_enqueue(q2, &data[3]);
+	TEST_ASSERT(queue_splice(q1, q2) == 0);
+	for (i = 0; i < 4; i++) {
+		queue_dequeue(q1, (void**)&ptr);
+		TEST_ASSERT(ptr == &data[i]);
+	}
+	TEST_ASSERT(queue_destroy(q2) == 0);
+}
+
+static int visited;
+
+static int find_item(queue_t q, void *data, void *arg)
+{
+	(void)q;
+	visited++;
+	return *(int*)data == *(int*)arg;
+}
+
+/* Find */
+void test_queue_find(void)
+{
+	int data[] = {1, 2, 3, 4, 5};
+	int key, *ptr = NULL, i;
+	queue_t q;
+
+	fprintf(stderr, "*** TEST queue_find ***\n");
+
+	q = queue_create();
+	for (i = 0; i < 5; i++)
+		queue_enqueue(q, &data[i]);
+
+	key = 2;
+	visited = 0;
+	TEST_ASSERT(queue_find(q, find_item, &key, (void**)&ptr) == 0);
+	TEST_ASSERT(ptr == &data[1]);
+	TEST_ASSERT(visited == 2);
+
+	key = 42;
+	TEST_ASSERT(queue_find(q, find_item, &key, NULL) == -1);
+}
+
+/* Typed queue node cache shrinking after a burst */
+void test_typed_queue_cache(void)
+{
+	struct int_queue q;
+	int i, item = 0, ok = 1;
+
+	fprintf(stderr, "*** TEST typed_queue_cache ***\n");
+
+	int_queue_init(&q);
+	for (i = 0; i < 1000; i++)
+		int_queue_enqueue(&q, i);
+	for (i = 0; i < 1000; i++)
+		ok &= int_queue_dequeue(&q, &item) == 0 && item == i;
+	TEST_ASSERT(ok);
+	TEST_ASSERT(int_queue_length(&q) == 0);
+	TEST_ASSERT(q.cached == TYPED_QUEUE_CACHE_MIN);
+
+	/* Steady state reuses cached nodes */
+	int_queue_enqueue(&q, 1);
+	int_queue_dequeue(&q, &item);
+	TEST_ASSERT(q.cached == TYPED_QUEUE_CACHE_MIN);
+
+	int_queue_fini(&q);
+}
+
+/* Typed queue removal of any node, in constant time */
+void test_typed_queue_remove(void)
+{
+	struct int_queue_node *nodes[5];
+	struct int_queue q;
+	int i, item = 0;
+
+	fprintf(stderr, "*** TEST typed_queue_remove ***\n");
+
+	int_queue_init(&q);
+	for (i = 0; i < 5; i++)
+		nodes[i] = int_queue_enqueue_node(&q, i);
+
+	/* Middle, front and back */
+	int_queue_remove(&q, nodes[2]);
+	int_queue_remove(&q, nodes[0]);
+	int_queue_remove(&q, nodes[4]);
+	TEST_ASSERT(int_queue_length(&q) == 2);
+	TEST_ASSERT(q.front == nodes[1] && q.front->prev == NULL);
+	TEST_ASSERT(q.back == nodes[3] && q.back->next == NULL);
+
+	/* The queue is still linked both ways */
+	nodes[4] = int_queue_enqueue_node(&q, 4);
+	int_queue_remove(&q, nodes[3]);
+	TEST_ASSERT(int_queue_dequeue(&q, &item) == 0 && item == 1);
+	TEST_ASSERT(q.front == nodes[4] && q.front->prev == NULL);
+	int_queue_remove(&q, nodes[4]);
+	TEST_ASSERT(int_queue_length(&q) == 0);
+	TEST_ASSERT(q.front == NULL && q.back == NULL);
+
+	int_queue_fini(&q);
+}
+
+/* Delete after batches and splices, which link nodes by hand */
+void test_queue_delete(void)
+{
+	int data[] = {1, 2, 3, 4, 5};
+	void *in[2] = { &data[1], &data[2] };
+	int *ptr;
+	queue_t q1, q2;
+
+	fprintf(stderr, "*** TEST queue_delete ***\n");
+
+	q1 = queue_create();
+	q2 = queue_create();
+	queue_enqueue(q1, &data[0]);
+	queue_enqueue_batch(q1, in, 2);
+	queue_enqueue(q2, &data[3]);
+	queue_enqueue(q2, &data[4]);
+	queue_splice(q1, q2);
+
+	TEST_ASSERT(queue_delete(q1, &data[3]) == 0);
+	TEST_ASSERT(queue_delete(q1, &data[4]) == 0);
+	TEST_ASSERT(queue_delete(q1, &data[1]) == 0);
+	TEST_ASSERT(queue_delete(q1, &data[1]) == -1);
+	TEST_ASSERT(queue_length(q1) == 2);
+	queue_dequeue(q1, (void**)&ptr);
+	TEST_ASSERT(ptr == &data[0]);
+	queue_dequeue(q1, (void**)&ptr);
+	TEST_ASSERT(ptr == &data[2]);
+	TEST_ASSERT(queue_destroy(q1) == 0);
+	TEST_ASSERT(queue_destroy(q2) == 0);
+}
+
 int main(void)
 {
 	test_create();
 	test_queue_simple();
+	test_queue_batch();
+	test_queue_splice();
+	test_queue_find();
+	test_typed_queue_cache();
+	test_typed_queue_remove();
+	test_queue_delete();
 
 	return 0;
 }
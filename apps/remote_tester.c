@@ -0,0 +1,195 @@
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <sem.h>
+#include <uthread.h>
+
+#define TEST_ASSERT(assert)				\
+do {									\
+	printf("ASSERT: " #assert " ... ");	\
+	if (assert) {						\
+		printf("PASS\n");				\
+	} else	{							\
+		printf("FAIL\n");				\
+		exit(1);						\
+	}									\
+} while(0)
+
+static uint64_t clock_ns(clockid_t clock)
+{
+	struct timespec ts;
+
+	clock_gettime(clock, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static sem_t sem;
+static int delay_usec;
+
+/* Release @sem from another kernel thread, after @delay_usec */
+static void *thread_release(void *arg)
+{
+	int i, count = (int)(intptr_t)arg;
+
+	usleep(delay_usec);
+	for (i = 0; i < count; i++)
+		sem_up_remote(sem);
+
+	return NULL;
+}
+
+/* With nothing to run, the scheduler sleeps until a remote release wakes it */
+void test_remote_wakeup(void)
+{
+	uint64_t wall, cpu;
+	pthread_t pthread;
+
+	fprintf(stderr, "*** TEST remote_wakeup ***\n");
+
+	sem = sem_create(0);
+	delay_usec = 100000;
+	TEST_ASSERT(uthread_start(UTHREAD_PREEMPT_NONE) == 0);
+	TEST_ASSERT(pthread_create(&pthread, NULL, thread_release, (void *)1) == 0);
+
+	wall = clock_ns(CLOCK_MONOTONIC);
+	cpu = clock_ns(CLOCK_PROCESS_CPUTIME_ID);
+	TEST_ASSERT(sem_down(sem) == 0);
+	wall = clock_ns(CLOCK_MONOTONIC) - wall;
+	cpu = clock_ns(CLOCK_PROCESS_CPUTIME_ID) - cpu;
+
+	// Slept through the wait instead of spinning
+	TEST_ASSERT(wall >= 90000000);
+	TEST_ASSERT(cpu < wall / 10);
+
+	pthread_join(pthread, NULL);
+	TEST_ASSERT(uthread_stop() == 0);
+	TEST_ASSERT(sem_destroy(sem) == 0);
+}
+
+#define POSTERS		4
+#define POSTS		10000
+#define CONSUMERS	4
+
+static void thread_consume(void *arg)
+{
+	int i;
+	(void)arg;
+
+	for (i = 0; i < POSTERS * POSTS / CONSUMERS; i++)
+		sem_down(sem);
+}
+
+/* No release made by several kernel threads at once is lost */
+void test_remote_many(void)
+{
+	pthread_t pthreads[POSTERS];
+	uthread_t tids[CONSUMERS];
+	int i;
+
+	fprintf(stderr, "*** TEST remote_many ***\n");
+
+	sem = sem_create(0);
+	delay_usec = 0;
+	TEST_ASSERT(uthread_start(UTHREAD_PREEMPT_NONE) == 0);
+	for (i = 0; i < CONSUMERS; i++)
+		tids[i] = uthread_create(thread_consume, NULL);
+	for (i = 0; i < POSTERS; i++)
+		pthread_create(&pthreads[i], NULL, thread_release, (void *)POSTS);
+	for (i = 0; i < CONSUMERS; i++)
+		TEST_ASSERT(uthread_join(tids[i], NULL) == 0);
+	for (i = 0; i < POSTERS; i++)
+		pthread_join(pthreads[i], NULL);
+	TEST_ASSERT(uthread_stop() == 0);
+	TEST_ASSERT(sem_destroy(sem) == 0);
+}
+
+/* Releases pending at, or made after, uthread_stop() survive a restart */
+void test_remote_restart(void)
+{
+	pthread_t pthread;
+
+	fprintf(stderr, "*** TEST remote_restart ***\n");
+
+	sem = sem_create(0);
+	delay_usec = 0;
+
+	// Posted, but never received before stopping
+	TEST_ASSERT(uthread_start(UTHREAD_PREEMPT_NONE) == 0);
+	TEST_ASSERT(sem_up_remote(sem) == 0);
+	TEST_ASSERT(uthread_stop() == 0);
+
+	// Posted while stopped
+	TEST_ASSERT(sem_up_remote(sem) == 0);
+
+	TEST_ASSERT(uthread_start(UTHREAD_PREEMPT_NONE) == 0);
+	TEST_ASSERT(sem_down(sem) == 0);
+	TEST_ASSERT(sem_down(sem) == 0);
+
+	// Later releases still get through
+	pthread_create(&pthread, NULL, thread_release, (void *)1);
+	TEST_ASSERT(sem_down(sem) == 0);
+	pthread_join(pthread, NULL);
+	TEST_ASSERT(uthread_stop() == 0);
+	TEST_ASSERT(sem_destroy(sem) == 0);
+}
+
+#define RESTARTS 200
+
+/* Wakeups racing with uthread_stop() never write to a recycled descriptor */
+void test_remote_stop_race(void)
+{
+	int i, fds[2], leaked = 0;
+	pthread_t pthread;
+	char c;
+
+	fprintf(stderr, "*** TEST remote_stop_race ***\n");
+
+	sem = sem_create(0);
+	delay_usec = 0;
+	TEST_ASSERT(pthread_create(&pthread, NULL, thread_release,
+				   (void *)(RESTARTS * 50)) == 0);
+
+	for (i = 0; i < RESTARTS; i++) {
+		if (uthread_start(UTHREAD_PREEMPT_NONE))
+			break;
+		sem_down(sem);
+		uthread_stop();
+
+		// Likely to get the number of the scheduler's descriptor
+		if (pipe(fds))
+			break;
+		fcntl(fds[0], F_SETFL, O_NONBLOCK);
+		if (read(fds[0], &c, 1) > 0)
+			leaked++;
+		close(fds[0]);
+		close(fds[1]);
+	}
+	TEST_ASSERT(i == RESTARTS);
+	TEST_ASSERT(leaked == 0);
+
+	// Take the releases left
+	pthread_join(pthread, NULL);
+	TEST_ASSERT(uthread_start(UTHREAD_PREEMPT_NONE) == 0);
+	for (; i < RESTARTS * 50; i++)
+		sem_down(sem);
+	TEST_ASSERT(uthread_stop() == 0);
+	TEST_ASSERT(sem_destroy(sem) == 0);
+}
+
+int main(void)
+{
+	// A lost wakeup shows up as a hang
+	alarm(60);
+
+	test_remote_wakeup();
+	test_remote_many();
+	test_remote_restart();
+	test_remote_stop_race();
+
+	return 0;
+}
@@ -0,0 +1,180 @@
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <sem.h>
+#include <uthread.h>
+
+#define TEST_ASSERT(assert)				\
+do {									\
+	printf("ASSERT: " #assert " ... ");	\
+	if (assert) {						\
+		printf("PASS\n");				\
+	} else	{							\
+		printf("FAIL\n");				\
+		exit(1);						\
+	}									\
+} while(0)
+
+static uint64_t clock_ns(clockid_t clock)
+{
+	struct timespec ts;
+
+	clock_gettime(clock, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+#define CHILDREN 4
+
+static int finished;
+static void *first_arg;
+
+static void thread_child(void *arg)
+{
+	(void)arg;
+
+	uthread_yield();
+	finished++;
+}
+
+static void thread_first(void *arg)
+{
+	int i;
+
+	first_arg = arg;
+	for (i = 0; i < CHILDREN; i++)
+		uthread_create(thread_child, NULL);
+	finished++;
+}
+
+/* uthread_run() returns once every thread, even unjoined ones, is done */
+void test_run_basic(void)
+{
+	int arg;
+
+	fprintf(stderr, "*** TEST run_basic ***\n");
+
+	finished = 0;
+	TEST_ASSERT(uthread_run(false, thread_first, &arg) == 0);
+	TEST_ASSERT(first_arg == &arg);
+	TEST_ASSERT(finished == CHILDREN + 1);
+
+	/* The library can be run again */
+	finished = 0;
+	TEST_ASSERT(uthread_run(false, thread_first, NULL) == 0);
+	TEST_ASSERT(finished == CHILDREN + 1);
+}
+
+#define WAITERS 3
+#define DELAY_USEC 100000
+
+static sem_t sem;
+static int woken;
+
+static void *thread_remote(void *arg)
+{
+	int i;
+	(void)arg;
+
+	usleep(DELAY_USEC);
+	for (i = 0; i < WAITERS; i++)
+		sem_up_remote(sem);
+
+	return NULL;
+}
+
+static void thread_wait(void *arg)
+{
+	(void)arg;
+
+	sem_down(sem);
+	woken++;
+}
+
+static void thread_spawn_waiters(void *arg)
+{
+	int i;
+	(void)arg;
+
+	for (i = 0; i < WAITERS; i++)
+		uthread_create(thread_wait, NULL);
+}
+
+/*
+ * With every thread blocked, the idle thread sleeps in the kernel instead of
+ * spinning, until a remote release wakes one of them up
+ */
+void test_run_idle(void)
+{
+	uint64_t wall, cpu;
+	pthread_t pthread;
+
+	fprintf(stderr, "*** TEST run_idle ***\n");
+
+	sem = sem_create(0);
+	woken = 0;
+	TEST_ASSERT(pthread_create(&pthread, NULL, thread_remote, NULL) == 0);
+
+	wall = clock_ns(CLOCK_MONOTONIC);
+	cpu = clock_ns(CLOCK_PROCESS_CPUTIME_ID);
+	TEST_ASSERT(uthread_run(false, thread_spawn_waiters, NULL) == 0);
+	wall = clock_ns(CLOCK_MONOTONIC) - wall;
+	cpu = clock_ns(CLOCK_PROCESS_CPUTIME_ID) - cpu;
+
+	pthread_join(pthread, NULL);
+	TEST_ASSERT(woken == WAITERS);
+	TEST_ASSERT(wall >= DELAY_USEC * 900ull);
+	TEST_ASSERT(cpu < wall / 10);
+	TEST_ASSERT(sem_destroy(sem) == 0);
+}
+
+static volatile int flag;
+
+/* Spin until another thread runs, which takes preemption */
+static void thread_spin(void *arg)
+{
+	(void)arg;
+
+	while (!flag)
+		;
+}
+
+static void thread_set(void *arg)
+{
+	(void)arg;
+
+	flag = 1;
+}
+
+static void thread_spawn_spinner(void *arg)
+{
+	(void)arg;
+
+	uthread_create(thread_spin, NULL);
+	uthread_create(thread_set, NULL);
+}
+
+/* With preemption, a thread that never yields does not keep the processor */
+void test_run_preempt(void)
+{
+	fprintf(stderr, "*** TEST run_preempt ***\n");
+
+	flag = 0;
+	TEST_ASSERT(uthread_run(true, thread_spawn_spinner, NULL) == 0);
+	TEST_ASSERT(flag == 1);
+}
+
+int main(void)
+{
+	// A scheduler that never wakes up shows up as a hang
+	alarm(30);
+
+	test_run_basic();
+	test_run_idle();
+	test_run_preempt();
+
+	return 0;
+}
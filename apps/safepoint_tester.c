@@ -0,0 +1,188 @@
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <uthread.h>
+
+#define TEST_ASSERT(assert)				\
+do {									\
+	printf("ASSERT: " #assert " ... ");	\
+	if (assert) {						\
+		printf("PASS\n");				\
+	} else	{							\
+		printf("FAIL\n");				\
+		exit(1);						\
+	}									\
+} while(0)
+
+#define SLICES		20
+#define QUANTUM_NS	10000000ull
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+	return (x > y) - (x < y);
+}
+
+/* Time at which each slice started, as seen by the thread switched in */
+static uint64_t switch_times[SLICES + 1];
+static int switches;
+static volatile uthread_t last_runner;
+static int gap_usec;
+
+/* Spin through safe-points @gap_usec apart, and note each switch-in */
+static void thread_spin(void *arg)
+{
+	uthread_t self = uthread_self();
+	(void)arg;
+
+	while (switches <= SLICES) {
+		uint64_t end = now_ns() + (uint64_t)gap_usec * 1000;
+
+		if (last_runner != self) {
+			last_runner = self;
+			switch_times[switches++] = now_ns();
+		}
+		while (gap_usec && now_ns() < end)
+			;
+		uthread_maybe_yield();
+	}
+}
+
+/* Run two spinning threads, and return the median slice length */
+static uint64_t run_slices(int gap, uint64_t *min)
+{
+	uint64_t slices[SLICES];
+	uthread_t tid1, tid2;
+	int i;
+
+	gap_usec = gap;
+	switches = 0;
+	last_runner = 0;
+
+	TEST_ASSERT(uthread_start(UTHREAD_PREEMPT_SAFEPOINT) == 0);
+	tid1 = uthread_create(thread_spin, NULL);
+	tid2 = uthread_create(thread_spin, NULL);
+	TEST_ASSERT(uthread_join(tid1, NULL) == 0);
+	TEST_ASSERT(uthread_join(tid2, NULL) == 0);
+	TEST_ASSERT(uthread_stop() == 0);
+
+	for (i = 0; i < SLICES; i++)
+		slices[i] = switch_times[i + 1] - switch_times[i];
+	qsort(slices, SLICES, sizeof(*slices), cmp_u64);
+	*min = slices[0];
+
+	return slices[SLICES / 2];
+}
+
+/* Dense safe-points: the running thread yields once its slice is used up */
+void test_slice_dense(void)
+{
+	uint64_t median, min;
+
+	fprintf(stderr, "*** TEST slice_dense ***\n");
+
+	median = run_slices(0, &min);
+	TEST_ASSERT(min >= QUANTUM_NS * 9 / 10);
+	TEST_ASSERT(median <= QUANTUM_NS * 3 / 2);
+}
+
+/* Sparse safe-points: the slice is not overrun by much more than the gap */
+void test_slice_sparse(void)
+{
+	uint64_t median, min;
+
+	fprintf(stderr, "*** TEST slice_sparse ***\n");
+
+	median = run_slices(200, &min);
+	TEST_ASSERT(min >= QUANTUM_NS * 9 / 10);
+	TEST_ASSERT(median <= QUANTUM_NS * 3 / 2);
+}
+
+#define FOREIGN_CALLS 200
+
+static pthread_t owner;
+static atomic_int foreign_runs;
+static atomic_int foreign_calls;
+static atomic_bool foreign_done;
+
+/* Safe-points crossed by a kernel thread that does not run the threads */
+static void *foreign_thread(void *arg)
+{
+	int i;
+	(void)arg;
+
+	for (i = 0; i < FOREIGN_CALLS; i++) {
+		// Force the slow path, well after the running thread's slice ended
+		uthread_safepoint_countdown = 1;
+		uthread_maybe_yield();
+		atomic_fetch_add(&foreign_calls, 1);
+		usleep(200);
+	}
+	atomic_store(&foreign_done, true);
+
+	return NULL;
+}
+
+/* Overrun the slice between safe-points, checking the kernel thread it runs on */
+static void thread_check_owner(void *arg)
+{
+	(void)arg;
+
+	while (!atomic_load(&foreign_done)) {
+		uint64_t end = now_ns() + QUANTUM_NS * 3;
+
+		while (now_ns() < end) {
+			if (!pthread_equal(pthread_self(), owner))
+				atomic_fetch_add(&foreign_runs, 1);
+		}
+		uthread_maybe_yield();
+	}
+}
+
+/* Safe-points in other kernel threads never switch threads */
+void test_foreign_thread(void)
+{
+	uthread_t tids[2];
+	pthread_t pthread;
+	int i;
+
+	fprintf(stderr, "*** TEST foreign_thread ***\n");
+
+	owner = pthread_self();
+	TEST_ASSERT(uthread_start(UTHREAD_PREEMPT_SAFEPOINT) == 0);
+	for (i = 0; i < 2; i++)
+		tids[i] = uthread_create(thread_check_owner, NULL);
+	TEST_ASSERT(pthread_create(&pthread, NULL, foreign_thread, NULL) == 0);
+	while (!atomic_load(&foreign_done))
+		uthread_maybe_yield();
+	for (i = 0; i < 2; i++)
+		TEST_ASSERT(uthread_join(tids[i], NULL) == 0);
+	TEST_ASSERT(uthread_stop() == 0);
+	pthread_join(pthread, NULL);
+
+	TEST_ASSERT(atomic_load(&foreign_calls) == FOREIGN_CALLS);
+	TEST_ASSERT(atomic_load(&foreign_runs) == 0);
+}
+
+int main(void)
+{
+	test_slice_dense();
+	test_slice_sparse();
+	test_foreign_thread();
+
+	return 0;
+}
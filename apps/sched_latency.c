@@ -0,0 +1,208 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <uthread.h>
+
+/*
+ * Measure the scheduling latency of the uthread scheduler, in the spirit of
+ * cyclictest: probe threads repeatedly make themselves runnable by yielding,
+ * and measure how long it takes until they actually run again, while
+ * background threads compete for the processor:
+ *
+ * - CPU-bound threads spin, and either get preempted (signal or safepoint
+ *   preemption) or yield after each burst (no preemption);
+ * - yielding threads do nothing but call uthread_yield().
+ *
+ * The distribution of all the samples is printed at the end.
+ */
+
+static int cpu_threads = 2;
+static int yield_threads = 2;
+static int probe_threads = 4;
+static int samples = 500;
+static int burst_usec = 100;
+static int mode = UTHREAD_PREEMPT_NONE;
+
+static uint64_t *latencies;
+static volatile int stop;
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static void cpu_thread(void *arg)
+{
+	(void)arg;
+
+	while (!stop) {
+		uint64_t end = now_ns() + (uint64_t)burst_usec * 1000;
+
+		switch (mode) {
+		case UTHREAD_PREEMPT_SIGNAL:
+			// Only the timer takes the processor away
+			while (!stop)
+				;
+			break;
+		case UTHREAD_PREEMPT_SAFEPOINT:
+			while (!stop)
+				uthread_maybe_yield();
+			break;
+		default:
+			while (now_ns() < end)
+				;
+			uthread_yield();
+			break;
+		}
+	}
+}
+
+static void yield_thread(void *arg)
+{
+	(void)arg;
+
+	while (!stop)
+		uthread_yield();
+}
+
+static void probe_thread(void *arg)
+{
+	uint64_t *slot = &latencies[(size_t)(uintptr_t)arg * samples];
+	int i;
+
+	for (i = 0; i < samples; i++) {
+		// The probe is runnable again as soon as it is back in line
+		uint64_t start = now_ns();
+
+		uthread_yield();
+		slot[i] = now_ns() - start;
+	}
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+	return (x > y) - (x < y);
+}
+
+static void print_report(uint64_t *v, size_t n)
+{
+	size_t buckets[64] = { 0 };
+	size_t i, max_count = 0;
+	int b, first = 64, last = 0;
+	double sum = 0;
+
+	qsort(v, n, sizeof(*v), cmp_u64);
+	for (i = 0; i < n; i++) {
+		sum += (double)v[i];
+		b = v[i] ? 63 - __builtin_clzll(v[i]) : 0;
+		buckets[b]++;
+	}
+
+	printf("samples: %zu\n", n);
+	printf("min:     %10.3f us\n", v[0] / 1e3);
+	printf("avg:     %10.3f us\n", sum / n / 1e3);
+	printf("p99:     %10.3f us\n", v[n * 99 / 100] / 1e3);
+	printf("p99.9:   %10.3f us\n", v[n * 999 / 1000] / 1e3);
+	printf("max:     %10.3f us\n", v[n - 1] / 1e3);
+
+	for (b = 0; b < 64; b++) {
+		if (buckets[b]) {
+			if (b < first)
+				first = b;
+			last = b;
+			if (buckets[b] > max_count)
+				max_count = buckets[b];
+		}
+	}
+
+	printf("\nhistogram (ns):\n");
+	for (b = first; b <= last; b++) {
+		int width = (int)(buckets[b] * 50 / max_count);
+
+		printf("[%12llu, %12llu) %8zu %.*s\n",
+		       1ull << b, 1ull << (b + 1), buckets[b], width,
+		       "##################################################");
+	}
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr, "Usage: %s [-c cpu_threads] [-y yield_threads] "
+		"[-p probe_threads] [-n samples_per_probe] [-b burst_usec] "
+		"[-m none|signal|safepoint]\n", prog);
+	exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+	uthread_t *tids;
+	int nthreads, opt, i, t = 0;
+
+	while ((opt = getopt(argc, argv, "c:y:p:n:b:m:")) != -1) {
+		switch (opt) {
+		case 'c': cpu_threads = atoi(optarg); break;
+		case 'y': yield_threads = atoi(optarg); break;
+		case 'p': probe_threads = atoi(optarg); break;
+		case 'n': samples = atoi(optarg); break;
+		case 'b': burst_usec = atoi(optarg); break;
+		case 'm':
+			if (!strcmp(optarg, "none"))
+				mode = UTHREAD_PREEMPT_NONE;
+			else if (!strcmp(optarg, "signal"))
+				mode = UTHREAD_PREEMPT_SIGNAL;
+			else if (!strcmp(optarg, "safepoint"))
+				mode = UTHREAD_PREEMPT_SAFEPOINT;
+			else
+				usage(argv[0]);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (cpu_threads < 0 || yield_threads < 0 || probe_threads < 1 ||
+	    samples < 1 || burst_usec < 0)
+		usage(argv[0]);
+
+	nthreads = cpu_threads + yield_threads + probe_threads;
+	latencies = malloc((size_t)probe_threads * samples * sizeof(*latencies));
+	tids = malloc(nthreads * sizeof(*tids));
+	if (!latencies || !tids || uthread_start(mode)) {
+		fprintf(stderr, "initialization failed\n");
+		return 1;
+	}
+
+	for (i = 0; i < cpu_threads; i++)
+		tids[t++] = uthread_create(cpu_thread, NULL);
+	for (i = 0; i < yield_threads; i++)
+		tids[t++] = uthread_create(yield_thread, NULL);
+	for (i = 0; i < probe_threads; i++)
+		tids[t++] = uthread_create(probe_thread, (void *)(uintptr_t)i);
+
+	// Background threads run until the last probe is done
+	for (i = cpu_threads + yield_threads; i < nthreads; i++)
+		uthread_join(tids[i], NULL);
+	stop = 1;
+	for (i = 0; i < cpu_threads + yield_threads; i++)
+		uthread_join(tids[i], NULL);
+	uthread_stop();
+
+	printf("cpu=%d yield=%d probes=%d burst=%dus preempt=%s\n\n",
+	       cpu_threads, yield_threads, probe_threads, burst_usec,
+	       mode == UTHREAD_PREEMPT_SIGNAL ? "signal" :
+	       mode == UTHREAD_PREEMPT_SAFEPOINT ? "safepoint" : "none");
+	print_report(latencies, (size_t)probe_threads * samples);
+
+	free(tids);
+	free(latencies);
+
+	return 0;
+}
@@ -0,0 +1,182 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <uthread.h>
+
+#define TEST_ASSERT(assert)				\
+do {									\
+	printf("ASSERT: " #assert " ... ");	\
+	if (assert) {						\
+		printf("PASS\n");				\
+	} else	{							\
+		printf("FAIL\n");				\
+		exit(1);						\
+	}									\
+} while(0)
+
+#define THREADS	8
+#define DEPTH	16
+#define ROUNDS	50
+
+/* Number of threads whose stack content was found corrupted */
+static int corrupted;
+
+/* Number of times a thread found another one had run while it was spinning */
+static int interleaved;
+static volatile uthread_t last_runner;
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+/* Spin for @usec microseconds, only giving the processor away if preempted */
+static void spin(int mode, int usec)
+{
+	uint64_t end = now_ns() + (uint64_t)usec * 1000;
+	uthread_t self = uthread_self();
+
+	last_runner = self;
+	while (now_ns() < end) {
+		if (mode == UTHREAD_PREEMPT_SAFEPOINT)
+			uthread_maybe_yield();
+		if (last_runner != self) {
+			interleaved++;
+			last_runner = self;
+		}
+	}
+}
+
+/*
+ * Fill a frame with a pattern specific to the thread and the depth, give the
+ * processor away at the bottom of the recursion, and check the pattern once
+ * back up
+ */
+static void stack_check(uintptr_t id, int depth, int mode, int spin_usec)
+{
+	volatile uintptr_t frame[64];
+	int i;
+
+	for (i = 0; i < 64; i++)
+		frame[i] = id * 1000003 + (uintptr_t)depth * 64 + i;
+
+	if (depth > 0) {
+		stack_check(id, depth - 1, mode, spin_usec);
+	} else {
+		uthread_yield();
+		last_runner = uthread_self();
+		if (spin_usec)
+			spin(mode, spin_usec);
+	}
+
+	for (i = 0; i < 64; i++) {
+		if (frame[i] != id * 1000003 + (uintptr_t)depth * 64 + i) {
+			corrupted++;
+			break;
+		}
+	}
+}
+
+static int thread_mode;
+
+static void thread_stack(void *arg)
+{
+	int round;
+
+	for (round = 0; round < ROUNDS; round++) {
+		/* Now and then, outlast a time slice to get preempted */
+		int spin_usec = thread_mode != UTHREAD_PREEMPT_NONE &&
+			round % 25 == 0 ? 12000 : 0;
+
+		stack_check((uintptr_t)arg, (int)((uintptr_t)arg + round) % DEPTH,
+			    thread_mode, spin_usec);
+	}
+}
+
+/* Run threads created with @create in preemption mode @mode */
+static void run_threads(int mode, uthread_t (*create)(uthread_func_t, void *))
+{
+	uthread_t tids[THREADS];
+	int i, ok = 1;
+
+	corrupted = 0;
+	interleaved = 0;
+	thread_mode = mode;
+
+	TEST_ASSERT(uthread_start(mode) == 0);
+	for (i = 0; i < THREADS; i++) {
+		tids[i] = create(thread_stack, (void *)(uintptr_t)(i + 1));
+		ok &= tids[i] != (uthread_t)-1;
+	}
+	TEST_ASSERT(ok);
+	for (i = 0; i < THREADS; i++)
+		ok &= uthread_join(tids[i], NULL) == 0;
+	TEST_ASSERT(ok);
+	TEST_ASSERT(uthread_stop() == 0);
+	TEST_ASSERT(corrupted == 0);
+}
+
+/* Private stacks across yields */
+void test_private_yield(void)
+{
+	fprintf(stderr, "*** TEST private_yield ***\n");
+
+	run_threads(UTHREAD_PREEMPT_NONE, uthread_create);
+}
+
+/* Shared stack across yields */
+void test_shared_yield(void)
+{
+	fprintf(stderr, "*** TEST shared_yield ***\n");
+
+	run_threads(UTHREAD_PREEMPT_NONE, uthread_create_shared);
+}
+
+/* Shared stack with private stack threads mixed in */
+static uthread_t create_mixed(uthread_func_t func, void *arg)
+{
+	if ((uintptr_t)arg % 2)
+		return uthread_create_shared(func, arg);
+	return uthread_create(func, arg);
+}
+
+void test_mixed_yield(void)
+{
+	fprintf(stderr, "*** TEST mixed_yield ***\n");
+
+	run_threads(UTHREAD_PREEMPT_NONE, create_mixed);
+}
+
+/* All stack kinds across signal preemption */
+void test_signal_preempt(void)
+{
+	fprintf(stderr, "*** TEST signal_preempt ***\n");
+
+	run_threads(UTHREAD_PREEMPT_SIGNAL, create_mixed);
+	TEST_ASSERT(interleaved > 0);
+}
+
+/* All stack kinds across safe-point preemption */
+void test_safepoint_preempt(void)
+{
+	fprintf(stderr, "*** TEST safepoint_preempt ***\n");
+
+	run_threads(UTHREAD_PREEMPT_SAFEPOINT, create_mixed);
+	TEST_ASSERT(interleaved > 0);
+}
+
+int main(void)
+{
+	test_private_yield();
+	test_shared_yield();
+	test_mixed_yield();
+	test_signal_preempt();
+	test_safepoint_preempt();
+
+	return 0;
+}
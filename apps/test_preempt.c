@@ -20,9 +20,7 @@ int thread1() {
 }
 
 int main(void) {
-    uthread_start(0);  // Start the threading library
-    uthread_join(uthread_create(thread1), NULL);  // Join thread 1, which creates thread 2
-    uthread_stop();  // Stop the threading library when done
+    uthread_run(true, thread1, NULL);  // Run thread 1, which creates thread 2, with preemption
 
     return 0;
 }
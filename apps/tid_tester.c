@@ -0,0 +1,106 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <uthread.h>
+
+#define TEST_ASSERT(assert)				\
+do {									\
+	printf("ASSERT: " #assert " ... ");	\
+	if (assert) {						\
+		printf("PASS\n");				\
+	} else	{							\
+		printf("FAIL\n");				\
+		exit(1);						\
+	}									\
+} while(0)
+
+static uthread_t seen_self;
+
+static void thread_self(void *arg)
+{
+	(void)arg;
+	seen_self = uthread_self();
+}
+
+static void thread_yield(void *arg)
+{
+	(void)arg;
+	uthread_yield();
+}
+
+/* TIDs of live threads */
+void test_tid_create(void)
+{
+	uthread_t t1, t2;
+
+	fprintf(stderr, "*** TEST tid_create ***\n");
+
+	uthread_start(UTHREAD_PREEMPT_NONE);
+	TEST_ASSERT(uthread_self() == 0);
+
+	t1 = uthread_create(thread_self, NULL);
+	t2 = uthread_create(thread_yield, NULL);
+	TEST_ASSERT(t1 != (uthread_t)-1 && t1 != 0);
+	TEST_ASSERT(t2 != (uthread_t)-1 && t2 != 0);
+	TEST_ASSERT(t1 != t2);
+
+	TEST_ASSERT(uthread_join(t1, NULL) == 0);
+	TEST_ASSERT(seen_self == t1);
+	TEST_ASSERT(uthread_join(t2, NULL) == 0);
+	uthread_stop();
+}
+
+/* Stale TIDs are rejected, even once their slot is reused */
+void test_tid_stale(void)
+{
+	uthread_t old, new;
+
+	fprintf(stderr, "*** TEST tid_stale ***\n");
+
+	uthread_start(UTHREAD_PREEMPT_NONE);
+
+	old = uthread_create(thread_yield, NULL);
+	TEST_ASSERT(uthread_join(old, NULL) == 0);
+	TEST_ASSERT(uthread_join(old, NULL) == -1);
+
+	new = uthread_create(thread_yield, NULL);
+	TEST_ASSERT(new != old);
+	TEST_ASSERT(uthread_join(old, NULL) == -1);
+	TEST_ASSERT(uthread_cancel(old) == -1);
+	TEST_ASSERT(uthread_yield_to(old) == -1);
+	TEST_ASSERT(uthread_set_deadline(old, 1) == -1);
+	TEST_ASSERT(uthread_join(new, NULL) == 0);
+
+	uthread_stop();
+}
+
+/* Stale TIDs stay rejected after many recycling rounds */
+void test_tid_recycle(void)
+{
+	uthread_t first, tid;
+	int i, ok = 1;
+
+	fprintf(stderr, "*** TEST tid_recycle ***\n");
+
+	uthread_start(UTHREAD_PREEMPT_NONE);
+
+	first = uthread_create(thread_yield, NULL);
+	TEST_ASSERT(uthread_join(first, NULL) == 0);
+	for (i = 0; i < 10000; i++) {
+		tid = uthread_create(thread_yield, NULL);
+		ok &= tid != first && uthread_join(tid, NULL) == 0;
+	}
+	TEST_ASSERT(ok);
+	TEST_ASSERT(uthread_join(first, NULL) == -1);
+
+	uthread_stop();
+}
+
+int main(void)
+{
+	test_tid_create();
+	test_tid_stale();
+	test_tid_recycle();
+
+	return 0;
+}
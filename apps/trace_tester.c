@@ -0,0 +1,276 @@
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sem.h>
+#include <trace.h>
+#include <uthread.h>
+
+#define TEST_ASSERT(assert)				\
+do {									\
+	printf("ASSERT: " #assert " ... ");	\
+	if (assert) {						\
+		printf("PASS\n");				\
+	} else	{							\
+		printf("FAIL\n");				\
+		exit(1);						\
+	}									\
+} while(0)
+
+static char path[] = "/tmp/trace_tester.XXXXXX";
+
+/* Dump the trace and read it back, to be freed by the caller */
+static char *dump(void)
+{
+	char *buf;
+	long size;
+	FILE *f;
+
+	if (uthread_trace_dump(path))
+		return NULL;
+
+	f = fopen(path, "r");
+	if (!f)
+		return NULL;
+	fseek(f, 0, SEEK_END);
+	size = ftell(f);
+	rewind(f);
+	buf = malloc(size + 1);
+	if (buf && fread(buf, 1, size, f) != (size_t)size) {
+		free(buf);
+		buf = NULL;
+	}
+	if (buf)
+		buf[size] = '\0';
+	fclose(f);
+
+	return buf;
+}
+
+/* Position of the instant event @name of thread @tid with argument @arg */
+static char *find_event(char *trace, const char *name, uthread_t tid, uint64_t arg)
+{
+	char head[128], tail[64], *p;
+
+	snprintf(head, sizeof(head), "{\"name\":\"%s\",\"ph\":\"i\",\"s\":\"t\","
+		 "\"pid\":1,\"tid\":%" PRIu64 ",", name, tid);
+	snprintf(tail, sizeof(tail), "\"args\":{\"arg\":%" PRIu64 "}}", arg);
+
+	for (p = strstr(trace, head); p; p = strstr(p + 1, head)) {
+		char *end = strchr(p, '\n'), *args = strstr(p, tail);
+
+		if (args && (!end || args < end))
+			return p;
+	}
+
+	return NULL;
+}
+
+/* Position of a running slice of thread @tid */
+static char *find_slice(char *trace, uthread_t tid)
+{
+	char head[128];
+
+	snprintf(head, sizeof(head), "{\"name\":\"running\",\"ph\":\"X\",\"pid\":1,"
+		 "\"tid\":%" PRIu64 ",", tid);
+
+	return strstr(trace, head);
+}
+
+static int count_events(const char *trace)
+{
+	int count = 0;
+
+	while ((trace = strstr(trace, "\n{")) != NULL) {
+		count++;
+		trace++;
+	}
+
+	return count;
+}
+
+/* Timestamps of instant events never go back, and slices never end early */
+static int timestamps_ordered(const char *trace)
+{
+	double ts, dur, last = 0;
+	const char *p;
+
+	for (p = strstr(trace, "\n{"); p; p = strstr(p + 1, "\n{")) {
+		const char *field = strstr(p, "\"ts\":");
+
+		if (!field || sscanf(field, "\"ts\":%lf", &ts) != 1)
+			return 0;
+		if (strncmp(p, "\n{\"name\":\"running\"", 18) == 0) {
+			field = strstr(p, "\"dur\":");
+			if (!field || sscanf(field, "\"dur\":%lf", &dur) != 1 || dur < 0)
+				return 0;
+			continue;
+		}
+		if (ts < last)
+			return 0;
+		last = ts;
+	}
+
+	return 1;
+}
+
+static sem_t sem;
+
+static void thread_wait(void *arg)
+{
+	(void)arg;
+
+	sem_down(sem);
+}
+
+/* Every kind of event is recorded, in order, with its thread and argument */
+void test_trace_events(void)
+{
+	char *trace, *create, *block, *unblock, *exit_;
+	uthread_t tid;
+
+	fprintf(stderr, "*** TEST trace_events ***\n");
+
+	uthread_start(UTHREAD_PREEMPT_NONE);
+	sem = sem_create(0);
+	uthread_trace_enable();
+	tid = uthread_create(thread_wait, NULL);
+	uthread_yield();
+	sem_up(sem);
+	uthread_join(tid, NULL);
+	uthread_trace_disable();
+
+	trace = dump();
+	TEST_ASSERT(trace != NULL);
+	TEST_ASSERT(strncmp(trace, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[", 39) == 0);
+	TEST_ASSERT(strcmp(trace + strlen(trace) - 4, "\n]}\n") == 0);
+
+	create = find_event(trace, "create", 0, tid);
+	block = find_event(trace, "block", tid, (uintptr_t)sem);
+	unblock = find_event(trace, "unblock", tid, 0);
+	exit_ = find_event(trace, "exit", tid, 0);
+	TEST_ASSERT(create && block && unblock && exit_);
+	TEST_ASSERT(create < block && block < unblock && unblock < exit_);
+
+	/* The join blocks on the TID of the joined thread */
+	TEST_ASSERT(find_event(trace, "block", 0, tid) != NULL);
+
+	/* Both threads got running slices */
+	TEST_ASSERT(find_slice(trace, 0) != NULL);
+	TEST_ASSERT(find_slice(trace, tid) != NULL);
+	TEST_ASSERT(timestamps_ordered(trace));
+	free(trace);
+
+	sem_destroy(sem);
+	TEST_ASSERT(uthread_stop() == 0);
+}
+
+static void thread_nop(void *arg)
+{
+	(void)arg;
+}
+
+/* Nothing is recorded while disabled, and enabling discards older events */
+void test_trace_enable(void)
+{
+	uthread_t tid1, tid2, tid3;
+	char *trace;
+
+	fprintf(stderr, "*** TEST trace_enable ***\n");
+
+	uthread_start(UTHREAD_PREEMPT_NONE);
+	uthread_trace_enable();
+	tid1 = uthread_create(thread_nop, NULL);
+	uthread_join(tid1, NULL);
+	uthread_trace_disable();
+	tid2 = uthread_create(thread_nop, NULL);
+	uthread_join(tid2, NULL);
+
+	trace = dump();
+	TEST_ASSERT(find_event(trace, "create", 0, tid1) != NULL);
+	TEST_ASSERT(find_event(trace, "create", 0, tid2) == NULL);
+	free(trace);
+
+	uthread_trace_enable();
+	tid3 = uthread_create(thread_nop, NULL);
+	uthread_join(tid3, NULL);
+	uthread_trace_disable();
+
+	trace = dump();
+	TEST_ASSERT(find_event(trace, "create", 0, tid1) == NULL);
+	TEST_ASSERT(find_event(trace, "create", 0, tid3) != NULL);
+	free(trace);
+
+	TEST_ASSERT(uthread_stop() == 0);
+}
+
+#define YIELDS 50000
+
+static void thread_yield(void *arg)
+{
+	int i;
+	(void)arg;
+
+	for (i = 0; i < YIELDS; i++)
+		uthread_yield();
+}
+
+/* Once the buffer is full, the oldest events are overwritten */
+void test_trace_wrap(void)
+{
+	uthread_t tid1, tid2;
+	char *trace;
+	int events;
+
+	fprintf(stderr, "*** TEST trace_wrap ***\n");
+
+	uthread_start(UTHREAD_PREEMPT_NONE);
+	uthread_trace_enable();
+	tid1 = uthread_create(thread_yield, NULL);
+	tid2 = uthread_create(thread_yield, NULL);
+	uthread_join(tid1, NULL);
+	uthread_join(tid2, NULL);
+	uthread_trace_disable();
+
+	trace = dump();
+	events = count_events(trace);
+	TEST_ASSERT(events > 0 && events <= 1 << 16);
+	TEST_ASSERT(find_event(trace, "create", 0, tid1) == NULL);
+	TEST_ASSERT(find_event(trace, "exit", tid2, 0) != NULL);
+	TEST_ASSERT(timestamps_ordered(trace));
+	free(trace);
+
+	TEST_ASSERT(uthread_stop() == 0);
+}
+
+/* Invalid paths */
+void test_trace_dump_args(void)
+{
+	fprintf(stderr, "*** TEST trace_dump_args ***\n");
+
+	uthread_start(UTHREAD_PREEMPT_NONE);
+	TEST_ASSERT(uthread_trace_dump(NULL) == -1);
+	TEST_ASSERT(uthread_trace_dump("/nonexistent/trace.json") == -1);
+	TEST_ASSERT(uthread_stop() == 0);
+}
+
+int main(void)
+{
+	int fd = mkstemp(path);
+
+	if (fd == -1)
+		return 1;
+	close(fd);
+
+	test_trace_events();
+	test_trace_enable();
+	test_trace_wrap();
+	test_trace_dump_args();
+
+	unlink(path);
+
+	return 0;
+}
@@ -0,0 +1,119 @@
+#include <inttypes.h>
+#include <linux/perf_event.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <uthread.h>
+
+/*
+ * Measure the cost of uthread_yield() with many threads in the ready queue, so
+ * that the TCBs and contexts touched by each switch do not all stay in cache.
+ * Cache misses are counted with perf events when the kernel allows it.
+ *
+ * Usage: yield_bench [threads] [yields_per_thread (at least 2)]
+ */
+
+static int yields = 1000;
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static int perf_open(uint32_t type, uint64_t config)
+{
+	struct perf_event_attr attr;
+
+	memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = type;
+	attr.config = config;
+	attr.disabled = 1;
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+
+	return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+static void yielder(void *arg)
+{
+	int i;
+
+	(void)arg;
+	for (i = 0; i < yields; i++)
+		uthread_yield();
+}
+
+int main(int argc, char *argv[])
+{
+	int threads = 1000;
+	uthread_t *tids;
+	uint64_t start, elapsed, total, misses = 0, l1_misses = 0;
+	int fd_misses, fd_l1, i;
+
+	if (argc > 1)
+		threads = atoi(argv[1]);
+	if (argc > 2)
+		yields = atoi(argv[2]);
+	// The first yield of each thread is not measured: at least one must be
+	if (threads < 1 || yields < 2) {
+		fprintf(stderr, "Usage: %s [threads] [yields_per_thread]\n", argv[0]);
+		return 1;
+	}
+
+	tids = malloc(threads * sizeof(*tids));
+	if (!tids || uthread_start(UTHREAD_PREEMPT_NONE))
+		return 1;
+
+	for (i = 0; i < threads; i++)
+		tids[i] = uthread_create(yielder, NULL);
+
+	// Let every thread start, so that only steady-state yields are measured
+	uthread_yield();
+
+	fd_misses = perf_open(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+	fd_l1 = perf_open(PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D |
+			  (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+			  (PERF_COUNT_HW_CACHE_RESULT_MISS << 16));
+	if (fd_misses >= 0)
+		ioctl(fd_misses, PERF_EVENT_IOC_ENABLE, 0);
+	if (fd_l1 >= 0)
+		ioctl(fd_l1, PERF_EVENT_IOC_ENABLE, 0);
+
+	start = now_ns();
+	for (i = 0; i < threads; i++)
+		uthread_join(tids[i], NULL);
+	elapsed = now_ns() - start;
+
+	if (fd_misses >= 0 && read(fd_misses, &misses, sizeof(misses)) != sizeof(misses))
+		fd_misses = -1;
+	if (fd_l1 >= 0 && read(fd_l1, &l1_misses, sizeof(l1_misses)) != sizeof(l1_misses))
+		fd_l1 = -1;
+
+	uthread_stop();
+
+	// Each switch between two threads stands for one yield
+	total = (uint64_t)threads * (yields - 1);
+	printf("threads=%d yields=%" PRIu64 "\n", threads, total);
+	printf("time:            %8.2f ns/yield\n", (double)elapsed / total);
+	if (fd_misses >= 0)
+		printf("cache misses:    %8.3f /yield\n", (double)misses / total);
+	else
+		printf("cache misses:    unavailable\n");
+	if (fd_l1 >= 0)
+		printf("L1D read misses: %8.3f /yield\n", (double)l1_misses / total);
+	else
+		printf("L1D read misses: unavailable\n");
+
+	free(tids);
+
+	return 0;
+}
@@ -0,0 +1,130 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "arena.h"
+#include "private.h"
+
+/* Size of regular chunks, header included */
+#define ARENA_CHUNK_SIZE 16384
+
+/* Number of regular chunks kept in the pool at most */
+#define ARENA_POOL_MAX 64
+
+#define ARENA_ALIGN _Alignof(max_align_t)
+#define ARENA_ROUND(size) (((size) + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1))
+
+struct uthread_arena_chunk {
+    struct uthread_arena_chunk *next;
+    size_t size;
+    max_align_t data[];
+};
+
+static struct uthread_arena_chunk *arena_pool;
+static size_t arena_pool_len;
+static size_t arena_stack_reserve;
+
+void uthread_arena_init(struct uthread_arena *arena, void *region, size_t size)
+{
+    arena->region = region;
+    arena->region_end = region ? (char *)region + size : NULL;
+    arena->cur = arena->region;
+    arena->end = arena->region_end;
+    arena->chunks = NULL;
+}
+
+void uthread_arena_release(struct uthread_arena *arena)
+{
+    struct uthread_arena_chunk *chunk, *next;
+
+    for (chunk = arena->chunks; chunk; chunk = next) {
+        next = chunk->next;
+        if (chunk->size == ARENA_CHUNK_SIZE && arena_pool_len < ARENA_POOL_MAX) {
+            chunk->next = arena_pool;
+            arena_pool = chunk;
+            arena_pool_len++;
+        } else {
+            free(chunk);
+        }
+    }
+
+    arena->cur = arena->region;
+    arena->end = arena->region_end;
+    arena->chunks = NULL;
+}
+
+/*
+ * Give @arena a new chunk large enough for @size bytes, taken from the pool if
+ * it is a regular one
+ */
+static int arena_grow(struct uthread_arena *arena, size_t size)
+{
+    struct uthread_arena_chunk *chunk = NULL;
+    size_t chunk_size = offsetof(struct uthread_arena_chunk, data) + size;
+
+    if (chunk_size < size) {
+        return -1;
+    }
+    if (chunk_size <= ARENA_CHUNK_SIZE) {
+        chunk_size = ARENA_CHUNK_SIZE;
+    }
+
+    // Keep malloc() out of reach of preemption
+    preempt_disable();
+    if (chunk_size == ARENA_CHUNK_SIZE && arena_pool) {
+        chunk = arena_pool;
+        arena_pool = chunk->next;
+        arena_pool_len--;
+    } else {
+        chunk = malloc(chunk_size);
+    }
+    preempt_enable();
+
+    if (!chunk) {
+        return -1;
+    }
+
+    chunk->size = chunk_size;
+    chunk->next = arena->chunks;
+    arena->chunks = chunk;
+    arena->cur = (char *)chunk->data;
+    arena->end = (char *)chunk + chunk_size;
+
+    return 0;
+}
+
+void *uthread_arena_alloc(size_t size)
+{
+    struct uthread_arena *arena = uthread_current_arena();
+    char *ptr;
+
+    if (size == 0 || size > SIZE_MAX - ARENA_ALIGN) {
+        return NULL;
+    }
+    size = ARENA_ROUND(size);
+
+    if ((size_t)(arena->end - arena->cur) < size && arena_grow(arena, size)) {
+        return NULL;
+    }
+
+    ptr = arena->cur;
+    arena->cur += size;
+
+    return ptr;
+}
+
+int uthread_arena_set_stack_reserve(size_t size)
+{
+    if (size > UTHREAD_ARENA_STACK_RESERVE_MAX) {
+        return -1;
+    }
+
+    arena_stack_reserve = ARENA_ROUND(size);
+
+    return 0;
+}
+
+size_t uthread_arena_stack_reserve(void)
+{
+    return arena_stack_reserve;
+}
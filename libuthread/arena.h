@@ -0,0 +1,50 @@
+#ifndef _ARENA_H
+#define _ARENA_H
+
+#include <stddef.h>
+
+/*
+ * Thread arenas
+ *
+ * Each thread has an arena, from which it can make allocations that all live
+ * until the thread exits, and are then released at once. Allocating is a
+ * pointer bump in the common case, and releasing costs one step per chunk of
+ * memory used, which are recycled through a global pool. Unlike malloc(), the
+ * arena is safe to use with signal-based preemption.
+ */
+
+/* Largest stack reservation accepted by uthread_arena_set_stack_reserve() */
+#define UTHREAD_ARENA_STACK_RESERVE_MAX 16384
+
+/*
+ * uthread_arena_alloc - Allocate memory from the running thread's arena
+ * @size: Number of bytes to allocate
+ *
+ * The memory is suitably aligned for any type. It cannot be freed on its own,
+ * and is released when the thread exits, after which it must not be used
+ * anymore (not even by the thread joining it).
+ *
+ * In a task run by the executor (see executor.h), the memory is released when
+ * the task returns instead, since workers outlive their tasks.
+ *
+ * Return: Pointer to the allocated memory, or NULL if @size is 0 or in case of
+ * memory allocation failure
+ */
+void *uthread_arena_alloc(size_t size);
+
+/*
+ * uthread_arena_set_stack_reserve - Place arenas in thread stacks
+ * @size: Number of bytes to reserve
+ *
+ * Reserve @size bytes at the far end of the stack of each thread created from
+ * now on (except in shared-stack mode), as the first region of its arena. The
+ * thread's stack shrinks accordingly. Threads whose allocations fit in this
+ * region never touch the global pool. 0, the default, disables the
+ * reservation.
+ *
+ * Return: -1 if @size is greater than UTHREAD_ARENA_STACK_RESERVE_MAX. 0
+ * otherwise.
+ */
+int uthread_arena_set_stack_reserve(size_t size);
+
+#endif /* _ARENA_H */
@@ -1,5 +1,7 @@
+#include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "private.h"
 #include "uthread.h"
@@ -7,6 +9,15 @@
 /* Size of the stack for a thread (in bytes) */
 #define UTHREAD_STACK_SIZE 32768
 
+/* Size of the stack shared by threads created in shared-stack mode */
+#define UTHREAD_SHARED_STACK_SIZE (1024 * 1024)
+
+/* Size of the private stack on which shared stacks are swapped */
+#define TRAMPOLINE_STACK_SIZE 16384
+
+/* Granularity of the save buffers of shared-stack threads */
+#define SHARED_SAVE_ROUND 256
+
 void uthread_ctx_switch(uthread_ctx_t *prev, uthread_ctx_t *next)
 {
 	/*
@@ -46,9 +57,12 @@ static void uthread_ctx_bootstrap(uthread_func_t func, void *arg)
 	uthread_exit();
 }
 
-int uthread_ctx_init(uthread_ctx_t *uctx, void *top_of_stack,
+int uthread_ctx_init(uthread_ctx_t *uctx, void *top_of_stack, size_t reserve,
 		     uthread_func_t func, void *arg)
 {
+	if (reserve > UTHREAD_STACK_SIZE / 2)
+		return -1;
+
 	/*
 	 * Initialize the passed context @uctx to the currently active context
 	 */
@@ -56,10 +70,11 @@ int uthread_ctx_init(uthread_ctx_t *uctx, void *top_of_stack,
 		return -1;
 
 	/*
-	 * Change context @uctx's stack to the specified stack
+	 * Change context @uctx's stack to the specified stack, minus the
+	 * reserved bytes at its low end (which it grows towards)
 	 */
-	uctx->uc_stack.ss_sp = top_of_stack;
-	uctx->uc_stack.ss_size = UTHREAD_STACK_SIZE;
+	uctx->uc_stack.ss_sp = (char *)top_of_stack + reserve;
+	uctx->uc_stack.ss_size = UTHREAD_STACK_SIZE - reserve;
 
 	/*
 	 * Finish setting up context @uctx:
@@ -74,3 +89,181 @@ int uthread_ctx_init(uthread_ctx_t *uctx, void *top_of_stack,
 	return 0;
 }
 
+
+/*
+ * Shared-stack mode
+ *
+ * All the shared-stack threads execute on the same large stack. The frames live
+ * on it belong to one thread at a time, the owner. When another shared-stack
+ * thread is switched in, the live part of the owner's stack (from its stack
+ * pointer up to the top) is copied into the owner's save buffer, and the frames
+ * of the new thread are copied back onto the shared stack. This is done lazily:
+ * running a thread with a private stack leaves the shared stack untouched.
+ *
+ * Since a thread cannot overwrite the stack it is running on, switching between
+ * two shared-stack threads goes through a trampoline context that has its own
+ * small stack.
+ */
+static char *shared_stack;
+static size_t shared_users;
+static struct uthread_ctx_shared *shared_owner;
+
+static ucontext_t trampoline_ctx;
+static void *trampoline_stack;
+static uthread_ctx_t *pending_uctx;
+static struct uthread_ctx_shared *pending_shared;
+
+/*
+ * Return an address below the stack frame of the caller, which is thus lower
+ * than any address the caller needs preserved across a context switch.
+ */
+static __attribute__((noinline)) char *ctx_stack_pointer(void)
+{
+	return __builtin_frame_address(0);
+}
+
+static void shared_save(struct uthread_ctx_shared *shared)
+{
+	size_t size = (size_t)(shared_stack + UTHREAD_SHARED_STACK_SIZE - shared->sp);
+
+	/* Keep the buffer sized to the live stack depth, without thrashing */
+	if (size > shared->capacity || size < shared->capacity / 4) {
+		size_t capacity = (size + SHARED_SAVE_ROUND - 1) & ~(size_t)(SHARED_SAVE_ROUND - 1);
+		char *buf = realloc(shared->buf, capacity);
+
+		if (buf == NULL && capacity > 0) {
+			perror("realloc");
+			exit(1);
+		}
+		shared->buf = buf;
+		shared->capacity = capacity;
+	}
+
+	memcpy(shared->buf, shared->sp, size);
+	shared->size = size;
+}
+
+/*
+ * Install the frames of @shared on the shared stack, first saving those of the
+ * current owner. Must not be called while running on the shared stack.
+ */
+static void shared_acquire(uthread_ctx_t *uctx, struct uthread_ctx_shared *shared)
+{
+	if (shared_owner == shared)
+		return;
+
+	if (shared_owner)
+		shared_save(shared_owner);
+	shared_owner = shared;
+
+	if (!shared->started) {
+		/* makecontext() writes the initial frame at the top of the stack */
+		shared->started = 1;
+		makecontext(uctx, (void (*)(void)) uthread_ctx_bootstrap,
+			    2, shared->func, shared->arg);
+	} else {
+		memcpy(shared_stack + UTHREAD_SHARED_STACK_SIZE - shared->size,
+		       shared->buf, shared->size);
+	}
+}
+
+static void ctx_trampoline(void)
+{
+	for (;;) {
+		shared_acquire(pending_uctx, pending_shared);
+		uthread_ctx_switch(&trampoline_ctx, pending_uctx);
+	}
+}
+
+static int shared_stack_get(void)
+{
+	if (shared_users++ > 0)
+		return 0;
+
+	shared_stack = malloc(UTHREAD_SHARED_STACK_SIZE);
+	trampoline_stack = malloc(TRAMPOLINE_STACK_SIZE);
+	if (shared_stack == NULL || trampoline_stack == NULL ||
+	    getcontext(&trampoline_ctx))
+		goto error;
+
+	/* Swapping stacks happens in the middle of a switch: never preempt it */
+	sigaddset(&trampoline_ctx.uc_sigmask, SIGVTALRM);
+	trampoline_ctx.uc_stack.ss_sp = trampoline_stack;
+	trampoline_ctx.uc_stack.ss_size = TRAMPOLINE_STACK_SIZE;
+	trampoline_ctx.uc_link = NULL;
+	makecontext(&trampoline_ctx, ctx_trampoline, 0);
+
+	return 0;
+
+error:
+	free(shared_stack);
+	free(trampoline_stack);
+	shared_stack = NULL;
+	trampoline_stack = NULL;
+	shared_users--;
+	return -1;
+}
+
+static void shared_stack_put(void)
+{
+	if (--shared_users > 0)
+		return;
+
+	free(shared_stack);
+	free(trampoline_stack);
+	shared_stack = NULL;
+	trampoline_stack = NULL;
+	shared_owner = NULL;
+}
+
+int uthread_ctx_init_shared(uthread_ctx_t *uctx, struct uthread_ctx_shared *shared,
+			    uthread_func_t func, void *arg)
+{
+	if (shared_stack_get())
+		return -1;
+
+	if (getcontext(uctx)) {
+		shared_stack_put();
+		return -1;
+	}
+
+	uctx->uc_stack.ss_sp = shared_stack;
+	uctx->uc_stack.ss_size = UTHREAD_SHARED_STACK_SIZE;
+	uctx->uc_link = NULL;
+
+	/* The initial frame is only built once the thread is first switched in */
+	memset(shared, 0, sizeof(*shared));
+	shared->func = func;
+	shared->arg = arg;
+
+	return 0;
+}
+
+void uthread_ctx_destroy_shared(struct uthread_ctx_shared *shared)
+{
+	if (shared_owner == shared)
+		shared_owner = NULL;
+	free(shared->buf);
+	shared->buf = NULL;
+	shared_stack_put();
+}
+
+void uthread_ctx_switch_shared(uthread_ctx_t *prev, struct uthread_ctx_shared *prev_shared,
+			       uthread_ctx_t *next, struct uthread_ctx_shared *next_shared)
+{
+	if (prev_shared)
+		prev_shared->sp = ctx_stack_pointer();
+
+	if (next_shared == NULL || shared_owner == next_shared) {
+		/* The stack of @next is already in place */
+		uthread_ctx_switch(prev, next);
+	} else if (prev_shared == NULL) {
+		/* Not running on the shared stack: swap its content right away */
+		shared_acquire(next, next_shared);
+		uthread_ctx_switch(prev, next);
+	} else {
+		pending_uctx = next;
+		pending_shared = next_shared;
+		uthread_ctx_switch(prev, &trampoline_ctx);
+	}
+}
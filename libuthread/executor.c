@@ -0,0 +1,228 @@
+#include <limits.h>
+#include <stddef.h>
+#include <stdlib.h>
+
+#include "executor.h"
+#include "park.h"
+#include "private.h"
+
+struct executor_task {
+    uthread_func_t func;
+    void *arg;
+};
+
+/*
+ * Tasks are kept in a ring buffer. Idle workers park on @work_seq and blocked
+ * submitters on @space_seq, which are bumped whenever a task gets queued or
+ * taken respectively (and on shutdown), so that no wakeup can slip between
+ * checking the ring and parking. Drainers park on @pending (tasks queued or
+ * running) until it drops to 0.
+ */
+static struct {
+    struct executor_task *tasks;
+    int capacity;
+    int head;
+    int queued;
+    int pending;
+    unsigned int work_seq;
+    unsigned int space_seq;
+    int idle_workers;
+    int stopping;
+
+    uthread_t *workers;
+    int nworkers;
+} executor;
+
+/* Stop counting a worker cancelled while idle */
+static void executor_idle_cancel(void *arg)
+{
+    (void)arg;
+
+    preempt_disable();
+    executor.idle_workers--;
+    preempt_enable();
+}
+
+/* Account for the end of the running task, even if it got cancelled */
+static void executor_task_done(void *arg)
+{
+    int done;
+    (void)arg;
+
+    // Arena allocations are scoped to the task, not to the worker
+    preempt_disable();
+    uthread_arena_release(uthread_current_arena());
+    done = --executor.pending == 0;
+    preempt_enable();
+
+    if (done) {
+        uthread_unpark(&executor.pending, INT_MAX);
+    }
+}
+
+static void executor_worker(void *arg)
+{
+    struct executor_task task;
+    unsigned int seq;
+    (void)arg;
+
+    uthread_set_worker();
+
+    for (;;) {
+        preempt_disable();
+        while (executor.queued == 0 && !executor.stopping) {
+            seq = executor.work_seq;
+            executor.idle_workers++;
+            preempt_enable();
+            uthread_cleanup_push(executor_idle_cancel, NULL);
+            uthread_park((int *)&executor.work_seq, (int)seq);
+            uthread_cleanup_pop(0);
+            preempt_disable();
+            executor.idle_workers--;
+        }
+
+        // Only exit once the queue is empty, even when stopping
+        if (executor.queued == 0) {
+            preempt_enable();
+            return;
+        }
+
+        task = executor.tasks[executor.head];
+        executor.head = (executor.head + 1) % executor.capacity;
+        executor.queued--;
+        executor.space_seq++;
+        preempt_enable();
+
+        uthread_unpark((int *)&executor.space_seq, 1);
+
+        uthread_cleanup_push(executor_task_done, NULL);
+        task.func(task.arg);
+        uthread_cleanup_pop(1);
+    }
+}
+
+int uthread_executor_start(int workers, int capacity)
+{
+    int i;
+
+    if (workers <= 0 || capacity <= 0 || executor.tasks) {
+        return -1;
+    }
+
+    executor.tasks = malloc(capacity * sizeof(*executor.tasks));
+    executor.workers = malloc(workers * sizeof(*executor.workers));
+    if (!executor.tasks || !executor.workers) {
+        free(executor.tasks);
+        free(executor.workers);
+        executor.tasks = NULL;
+        executor.workers = NULL;
+        return -1;
+    }
+
+    executor.capacity = capacity;
+    executor.head = 0;
+    executor.queued = 0;
+    executor.pending = 0;
+    executor.work_seq = 0;
+    executor.space_seq = 0;
+    executor.idle_workers = 0;
+    executor.stopping = 0;
+    executor.nworkers = 0;
+
+    for (i = 0; i < workers; i++) {
+        uthread_t tid = uthread_create(executor_worker, NULL);
+
+        if (tid == (uthread_t)-1) {
+            uthread_executor_shutdown();
+            return -1;
+        }
+        executor.workers[executor.nworkers++] = tid;
+    }
+
+    return 0;
+}
+
+int uthread_executor_submit(uthread_func_t func, void *arg)
+{
+    unsigned int seq;
+    int wake;
+
+    if (func == NULL) {
+        return -1;
+    }
+
+    preempt_disable();
+    for (;;) {
+        if (!executor.tasks || executor.stopping) {
+            preempt_enable();
+            return -1;
+        }
+        if (executor.queued < executor.capacity) {
+            break;
+        }
+        seq = executor.space_seq;
+        preempt_enable();
+        uthread_park((int *)&executor.space_seq, (int)seq);
+        preempt_disable();
+    }
+
+    executor.tasks[(executor.head + executor.queued) % executor.capacity] =
+        (struct executor_task){ func, arg };
+    executor.queued++;
+    executor.pending++;
+    executor.work_seq++;
+    wake = executor.idle_workers > 0;
+    preempt_enable();
+
+    if (wake) {
+        uthread_unpark((int *)&executor.work_seq, 1);
+    }
+
+    return 0;
+}
+
+int uthread_executor_drain(void)
+{
+    int pending;
+
+    if (!executor.tasks) {
+        return -1;
+    }
+
+    while ((pending = executor.pending) != 0) {
+        uthread_park(&executor.pending, pending);
+    }
+
+    return 0;
+}
+
+int uthread_executor_shutdown(void)
+{
+    int i;
+
+    if (!executor.tasks) {
+        return -1;
+    }
+
+    preempt_disable();
+    executor.stopping = 1;
+    executor.work_seq++;
+    executor.space_seq++;
+    preempt_enable();
+
+    // Turn blocked submitters away, and let idle workers see the news
+    uthread_unpark((int *)&executor.space_seq, INT_MAX);
+    uthread_unpark((int *)&executor.work_seq, INT_MAX);
+
+    for (i = 0; i < executor.nworkers; i++) {
+        uthread_join(executor.workers[i], NULL);
+    }
+
+    free(executor.tasks);
+    free(executor.workers);
+    executor.tasks = NULL;
+    executor.workers = NULL;
+    executor.nworkers = 0;
+
+    return 0;
+}
@@ -0,0 +1,74 @@
+#ifndef _EXECUTOR_H
+#define _EXECUTOR_H
+
+#include "uthread.h"
+
+/*
+ * Executor
+ *
+ * The executor runs short tasks on a fixed pool of long-lived worker threads,
+ * so that each task only costs a push in a bounded queue instead of the
+ * creation and destruction of a thread. Idle workers wait in the parking lot
+ * and use no processor time.
+ *
+ * There is a single executor, which must only be used from the threads of the
+ * library.
+ *
+ * A worker cancelled while running a task exits once the task's cleanup
+ * handlers have run. The task then counts as done, and the pool keeps one
+ * worker less until the executor is restarted.
+ */
+
+/*
+ * uthread_executor_start - Start the executor
+ * @workers: Number of worker threads
+ * @capacity: Maximum number of tasks waiting to be run
+ *
+ * Return: -1 if @workers or @capacity is not positive, if the executor is
+ * already started, or in case of failure (e.g., memory allocation, thread
+ * creation). 0 otherwise.
+ */
+int uthread_executor_start(int workers, int capacity);
+
+/*
+ * uthread_executor_submit - Submit a task to the executor
+ * @func: Function to run
+ * @arg: Argument to pass to @func
+ *
+ * Queue the call of @func with @arg, to be run by the first idle worker. Tasks
+ * are started in submission order. If the queue is full, block the caller
+ * until a worker takes a task out of it (which never happens if the caller is
+ * a worker and all the workers are doing the same).
+ *
+ * A task must not wait for another task it submits, which may never start if
+ * all the workers are waiting likewise (use uthread_async() instead, see
+ * future.h). What a task allocates from its arena is released when it returns
+ * (see uthread_arena_alloc()).
+ *
+ * Return: -1 if @func is NULL, or if the executor is not started or is being
+ * shut down. 0 otherwise.
+ */
+int uthread_executor_submit(uthread_func_t func, void *arg);
+
+/*
+ * uthread_executor_drain - Wait for the executor to be idle
+ *
+ * Block the caller until every submitted task has been run to completion. Not
+ * to be called from a task.
+ *
+ * Return: -1 if the executor is not started. 0 otherwise.
+ */
+int uthread_executor_drain(void);
+
+/*
+ * uthread_executor_shutdown - Stop the executor
+ *
+ * Refuse any new task, let the workers run the tasks already submitted, then
+ * wait for the workers to exit and release the executor, which can then be
+ * started again. Not to be called from a task.
+ *
+ * Return: -1 if the executor is not started. 0 otherwise.
+ */
+int uthread_executor_shutdown(void);
+
+#endif /* _EXECUTOR_H */
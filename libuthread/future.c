@@ -0,0 +1,257 @@
+#include <limits.h>
+#include <stddef.h>
+#include <stdlib.h>
+
+#include "executor.h"
+#include "future.h"
+#include "park.h"
+#include "private.h"
+
+struct future {
+    // Park word of future_get(), 1 once the result is in
+    int done;
+    void *result;
+
+    // Asynchronous function, or continuation function
+    future_func_t func;
+    future_then_func_t then_func;
+    void *arg;
+
+    // Future of the continuation, if any
+    struct future *then;
+
+    struct future *next_free;
+};
+
+static struct future *future_pool;
+
+/*
+ * Bumped whenever any future gets done, for future_wait_any() to park on. It is
+ * only worth waking anyone up when there are such waiters.
+ */
+static unsigned int future_seq;
+static int future_any_waiters;
+
+static struct future *future_alloc(void)
+{
+    struct future *future;
+
+    preempt_disable();
+    future = future_pool;
+    if (future) {
+        future_pool = future->next_free;
+    }
+    preempt_enable();
+
+    if (!future) {
+        future = malloc(sizeof(*future));
+        if (!future) {
+            return NULL;
+        }
+    }
+
+    future->done = 0;
+    future->result = NULL;
+    future->func = NULL;
+    future->then_func = NULL;
+    future->arg = NULL;
+    future->then = NULL;
+    future->next_free = NULL;
+
+    return future;
+}
+
+static void future_free(struct future *future)
+{
+    preempt_disable();
+    future->next_free = future_pool;
+    future_pool = future;
+    preempt_enable();
+}
+
+/*
+ * Store @result in @future and wake its waiters up, then run the chain of
+ * continuations hanging from it
+ */
+static void future_complete(struct future *future, void *result)
+{
+    struct future *then;
+    int wake_any;
+
+    while (future) {
+        preempt_disable();
+        future->result = result;
+        future->done = 1;
+        future_seq++;
+        wake_any = future_any_waiters > 0;
+        then = future->then;
+        preempt_enable();
+
+        uthread_unpark(&future->done, INT_MAX);
+        if (wake_any) {
+            uthread_unpark((int *)&future_seq, INT_MAX);
+        }
+
+        if (then) {
+            result = then->then_func(result, then->arg);
+        }
+        future = then;
+    }
+}
+
+static void future_run(void *arg)
+{
+    struct future *future = (struct future *)arg;
+
+    future_complete(future, future->func(future->arg));
+}
+
+future_t uthread_async(future_func_t func, void *arg)
+{
+    struct future *future;
+
+    if (func == NULL) {
+        return NULL;
+    }
+
+    future = future_alloc();
+    if (!future) {
+        return NULL;
+    }
+    future->func = func;
+    future->arg = arg;
+
+    /*
+     * A worker waiting for futures it queued to the executor itself would
+     * deadlock once all the workers do the same, so workers get a thread of
+     * their own for each call instead.
+     */
+    if ((uthread_is_worker() || uthread_executor_submit(future_run, future)) &&
+        uthread_create_detached(future_run, future) == (uthread_t)-1) {
+        future_free(future);
+        return NULL;
+    }
+
+    return future;
+}
+
+int future_get(future_t future, void **result)
+{
+    if (future == NULL) {
+        return -1;
+    }
+
+    while (!future->done) {
+        uthread_park(&future->done, 0);
+    }
+
+    if (result) {
+        *result = future->result;
+    }
+
+    return 0;
+}
+
+/* Stop counting a future_wait_any() waiter cancelled while parked */
+static void future_any_cancel(void *arg)
+{
+    (void)arg;
+
+    preempt_disable();
+    future_any_waiters--;
+    preempt_enable();
+}
+
+int future_wait_any(future_t *futures, int count)
+{
+    unsigned int seq;
+    int i;
+
+    if (futures == NULL || count <= 0) {
+        return -1;
+    }
+    for (i = 0; i < count; i++) {
+        if (futures[i] == NULL) {
+            return -1;
+        }
+    }
+
+    preempt_disable();
+    for (;;) {
+        for (i = 0; i < count; i++) {
+            if (futures[i]->done) {
+                preempt_enable();
+                return i;
+            }
+        }
+
+        seq = future_seq;
+        future_any_waiters++;
+        preempt_enable();
+        uthread_cleanup_push(future_any_cancel, NULL);
+        uthread_park((int *)&future_seq, (int)seq);
+        uthread_cleanup_pop(0);
+        preempt_disable();
+        future_any_waiters--;
+    }
+}
+
+int future_wait_all(future_t *futures, int count)
+{
+    int i;
+
+    if (futures == NULL || count < 0) {
+        return -1;
+    }
+    for (i = 0; i < count; i++) {
+        if (futures[i] == NULL) {
+            return -1;
+        }
+    }
+
+    for (i = 0; i < count; i++) {
+        future_get(futures[i], NULL);
+    }
+
+    return 0;
+}
+
+future_t future_then(future_t future, future_then_func_t func, void *arg)
+{
+    struct future *then;
+
+    if (future == NULL || func == NULL || future->then) {
+        return NULL;
+    }
+
+    then = future_alloc();
+    if (!then) {
+        return NULL;
+    }
+    then->then_func = func;
+    then->arg = arg;
+
+    preempt_disable();
+    future->then = then;
+    if (!future->done) {
+        preempt_enable();
+        return then;
+    }
+    preempt_enable();
+
+    // Already done: nobody else will ever run the continuation
+    future_complete(then, func(future->result, arg));
+
+    return then;
+}
+
+int future_release(future_t future)
+{
+    if (future == NULL || !future->done) {
+        return -1;
+    }
+
+    future_free(future);
+
+    return 0;
+}
@@ -0,0 +1,122 @@
+#ifndef _FUTURE_H
+#define _FUTURE_H
+
+#include "uthread.h"
+
+/*
+ * Futures
+ *
+ * A future holds the result of a function running asynchronously, which can
+ * later be waited for and retrieved without joining any thread. Futures are
+ * taken from a pool and given back to it with future_release(), so that
+ * steady-state use allocates no memory.
+ */
+
+/*
+ * future_t - Future type
+ *
+ * A future is either pending or done, in which case it holds a result.
+ */
+typedef struct future *future_t;
+
+/*
+ * future_func_t - Asynchronous function type
+ * @arg: Argument given to uthread_async()
+ *
+ * Return: Result of the function, to be stored in its future
+ */
+typedef void *(*future_func_t)(void *arg);
+
+/*
+ * future_then_func_t - Continuation function type
+ * @result: Result of the future the continuation is attached to
+ * @arg: Argument given to future_then()
+ *
+ * Return: Result of the continuation, to be stored in its own future
+ */
+typedef void *(*future_then_func_t)(void *result, void *arg);
+
+/*
+ * uthread_async - Run a function asynchronously
+ * @func: Function to run
+ * @arg: Argument to pass to @func
+ *
+ * Run @func with @arg, on the executor if it is started (see executor.h), or
+ * in a new thread otherwise. The thread is destroyed as soon as @func returns.
+ *
+ * Calls made from a task running on the executor always use a new thread:
+ * tasks waiting for futures queued behind them on the executor could otherwise
+ * occupy every worker, and wait forever. Fanning out from a task thus works,
+ * but costs a thread per call.
+ *
+ * Return: Future receiving the result of @func, or NULL in case of failure
+ * (e.g., memory allocation, thread creation)
+ */
+future_t uthread_async(future_func_t func, void *arg);
+
+/*
+ * future_get - Wait for a future and retrieve its result
+ * @future: Future to wait for
+ * @result: Address of data item where the result is received
+ *
+ * Block the calling thread, and only it, until @future is done. @result can be
+ * NULL, in which case the result is not received.
+ *
+ * Return: -1 if @future is NULL. 0 otherwise.
+ */
+int future_get(future_t future, void **result);
+
+/*
+ * future_wait_any - Wait for any of a set of futures
+ * @futures: Array of futures
+ * @count: Number of futures in @futures
+ *
+ * Block the calling thread until at least one of the futures in @futures is
+ * done.
+ *
+ * Return: -1 if @futures is NULL, if @count is not positive, or if any of the
+ * futures is NULL. Index of the first future found done otherwise.
+ */
+int future_wait_any(future_t *futures, int count);
+
+/*
+ * future_wait_all - Wait for all of a set of futures
+ * @futures: Array of futures
+ * @count: Number of futures in @futures
+ *
+ * Block the calling thread until all the futures in @futures are done.
+ *
+ * Return: -1 if @futures is NULL, if @count is negative, or if any of the
+ * futures is NULL. 0 otherwise.
+ */
+int future_wait_all(future_t *futures, int count);
+
+/*
+ * future_then - Attach a continuation to a future
+ * @future: Future to attach to
+ * @func: Continuation function
+ * @arg: Argument to pass to @func
+ *
+ * Arrange for @func to be called with the result of @future and @arg once
+ * @future is done. No thread is created: @func runs inline, in the thread
+ * completing @future, or right away in the calling thread if @future is
+ * already done. A future can only have one continuation, but continuations can
+ * be chained.
+ *
+ * Return: Future receiving the result of @func, or NULL if @future is NULL or
+ * already has a continuation, or in case of memory allocation failure
+ */
+future_t future_then(future_t future, future_then_func_t func, void *arg);
+
+/*
+ * future_release - Give a future back to the pool
+ * @future: Future to release
+ *
+ * The future, which must not be used anymore, is released even if it has a
+ * continuation (whose own future stays valid).
+ *
+ * Return: -1 if @future is NULL or is still pending. 0 otherwise.
+ */
+int future_release(future_t future);
+
+#endif /* _FUTURE_H */
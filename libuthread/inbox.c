@@ -0,0 +1,153 @@
+#include <errno.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+#include "private.h"
+
+/*
+ * Intrusive multi-producer single-consumer queue (D. Vyukov's algorithm).
+ *
+ * Producers only do an atomic exchange on inbox_head followed by a store, so
+ * posting never waits on another thread. The scheduler is the only consumer
+ * and walks the list from inbox_tail. A stub node keeps the list non-empty so
+ * that producers never have to touch inbox_tail.
+ */
+static struct uthread_inbox_node inbox_stub;
+static struct uthread_inbox_node *_Atomic inbox_head = &inbox_stub;
+static struct uthread_inbox_node *inbox_tail = &inbox_stub;
+
+/*
+ * Event counter the scheduler sleeps on when it has nothing to run, and number
+ * of posters that may be about to write to it, which it cannot be closed under
+ */
+static atomic_int inbox_fd = -1;
+static atomic_int inbox_posters;
+static atomic_bool inbox_sleeping;
+
+int uthread_inbox_init(void)
+{
+    inbox_fd = eventfd(0, EFD_CLOEXEC);
+    if (inbox_fd == -1) {
+        return -1;
+    }
+
+    // Entries posted while the library was stopped are kept for this run
+    atomic_store(&inbox_sleeping, false);
+
+    return 0;
+}
+
+void uthread_inbox_fini(void)
+{
+    // Make late posts skip the wakeup, and wait for those already writing
+    int fd = atomic_exchange(&inbox_fd, -1);
+
+    while (atomic_load(&inbox_posters) > 0) {
+        sched_yield();
+    }
+    if (fd != -1) {
+        close(fd);
+    }
+}
+
+static void inbox_push(struct uthread_inbox_node *node)
+{
+    struct uthread_inbox_node *prev;
+
+    atomic_store_explicit(&node->next, NULL, memory_order_relaxed);
+    prev = atomic_exchange(&inbox_head, node);
+    atomic_store_explicit(&prev->next, node, memory_order_release);
+}
+
+/*
+ * Pop the oldest node, or return NULL if the inbox is empty or if the oldest
+ * producer is still in the middle of linking its node (it will be picked up at
+ * the next scheduling point).
+ */
+static struct uthread_inbox_node *inbox_pop(void)
+{
+    struct uthread_inbox_node *tail = inbox_tail;
+    struct uthread_inbox_node *next;
+
+    next = atomic_load_explicit(&tail->next, memory_order_acquire);
+    if (tail == &inbox_stub) {
+        if (next == NULL) {
+            return NULL;
+        }
+        inbox_tail = next;
+        tail = next;
+        next = atomic_load_explicit(&next->next, memory_order_acquire);
+    }
+
+    if (next) {
+        inbox_tail = next;
+        return tail;
+    }
+
+    if (tail != atomic_load(&inbox_head)) {
+        return NULL;
+    }
+
+    inbox_push(&inbox_stub);
+    next = atomic_load_explicit(&tail->next, memory_order_acquire);
+    if (next) {
+        inbox_tail = next;
+        return tail;
+    }
+
+    return NULL;
+}
+
+void uthread_inbox_post(struct uthread_inbox_node *node)
+{
+    uint64_t one = 1;
+    int fd;
+
+    inbox_push(node);
+
+    /*
+     * Only pay for the system call if the scheduler announced it was going to
+     * sleep. Both sides use sequentially consistent accesses, so either we see
+     * the announcement, or the scheduler sees our node before sleeping.
+     *
+     * Announcing the write before loading the descriptor keeps
+     * uthread_inbox_fini() from closing it under us: either it sees us and
+     * waits, or we see the descriptor already swapped out.
+     */
+    if (atomic_load(&inbox_sleeping)) {
+        atomic_fetch_add(&inbox_posters, 1);
+        if ((fd = atomic_load(&inbox_fd)) != -1) {
+            while (write(fd, &one, sizeof(one)) == -1 && errno == EINTR)
+                ;
+        }
+        atomic_fetch_sub(&inbox_posters, 1);
+    }
+}
+
+void uthread_inbox_drain(void)
+{
+    struct uthread_inbox_node *node;
+
+    while ((node = inbox_pop()) != NULL) {
+        node->func(node);
+    }
+}
+
+void uthread_inbox_wait(void)
+{
+    uint64_t count;
+
+    atomic_store(&inbox_sleeping, true);
+    if (atomic_load(&inbox_head) == inbox_tail) {
+        while (read(inbox_fd, &count, sizeof(count)) == -1 && errno == EINTR)
+            ;
+    }
+    atomic_store(&inbox_sleeping, false);
+}
@@ -0,0 +1,126 @@
+#include <stddef.h>
+#include <stdint.h>
+
+#include "park.h"
+#include "private.h"
+
+/* Number of buckets in the hash table (must be a power of 2) */
+#define PARK_BUCKETS 256
+
+/*
+ * Each bucket holds the threads waiting on the addresses hashing to it, in a
+ * doubly-linked list threaded through the waiter entries of their TCBs, oldest
+ * first. Empty buckets hold no memory besides their two pointers.
+ */
+struct park_bucket {
+    struct uthread_waiter *head;
+    struct uthread_waiter *tail;
+};
+
+static struct park_bucket park_table[PARK_BUCKETS];
+
+static struct park_bucket *park_bucket(const void *addr)
+{
+    uint64_t key = (uint64_t)(uintptr_t)addr;
+
+    // Fibonacci hashing, dropping the bits that are always 0 for an int
+    return &park_table[((key >> 2) * 0x9e3779b97f4a7c15ull) >> 56 & (PARK_BUCKETS - 1)];
+}
+
+static void park_unlink(struct park_bucket *bucket, struct uthread_waiter *waiter)
+{
+    if (waiter->prev) {
+        waiter->prev->next = waiter->next;
+    } else {
+        bucket->head = waiter->next;
+    }
+
+    if (waiter->next) {
+        waiter->next->prev = waiter->prev;
+    } else {
+        bucket->tail = waiter->prev;
+    }
+
+    waiter->next = NULL;
+    waiter->prev = NULL;
+    waiter->addr = NULL;
+}
+
+/* Take a cancelled waiter out of its bucket */
+static void park_cancel_wait(struct uthread_tcb *uthread, void *arg)
+{
+    struct uthread_waiter *waiter = (struct uthread_waiter *)arg;
+    (void)uthread;
+
+    park_unlink(park_bucket(waiter->addr), waiter);
+}
+
+int uthread_park(int *addr, int expected)
+{
+    struct park_bucket *bucket;
+    struct uthread_waiter *waiter;
+
+    if (addr == NULL) {
+        return -1;
+    }
+
+    uthread_testcancel();
+
+    preempt_disable();
+
+    if (*addr != expected) {
+        preempt_enable();
+        return -1;
+    }
+
+    bucket = park_bucket(addr);
+    waiter = uthread_current_waiter();
+    waiter->addr = addr;
+    waiter->next = NULL;
+    waiter->prev = bucket->tail;
+    if (bucket->tail) {
+        bucket->tail->next = waiter;
+    } else {
+        bucket->head = waiter;
+    }
+    bucket->tail = waiter;
+
+    TRACE(TRACE_BLOCK, uthread_self(), (uintptr_t)addr);
+    if (uthread_block_cancelable(park_cancel_wait, waiter)) {
+        preempt_enable();
+        uthread_testcancel();
+    }
+
+    preempt_enable();
+
+    return 0;
+}
+
+int uthread_unpark(int *addr, int count)
+{
+    struct park_bucket *bucket;
+    struct uthread_waiter *waiter, *next;
+    int woken = 0;
+
+    if (addr == NULL || count < 0) {
+        return -1;
+    }
+
+    preempt_disable();
+
+    bucket = park_bucket(addr);
+    for (waiter = bucket->head; waiter && woken < count; waiter = next) {
+        next = waiter->next;
+        if (waiter->addr != addr) {
+            continue;
+        }
+
+        park_unlink(bucket, waiter);
+        uthread_unblock(waiter->uthread);
+        woken++;
+    }
+
+    preempt_enable();
+
+    return woken;
+}
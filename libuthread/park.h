@@ -0,0 +1,42 @@
+#ifndef _PARK_H
+#define _PARK_H
+
+/*
+ * Parking lot
+ *
+ * The parking lot lets threads wait on any integer in memory, in the manner of
+ * futexes. A synchronization object built on top of it can thus be a single
+ * word, with no allocation: waiters are kept in a global hash table keyed by
+ * address, and only take room in it while they are actually waiting.
+ */
+
+/*
+ * uthread_park - Wait on an address
+ * @addr: Address of the integer to wait on
+ * @expected: Value that *@addr must still hold for the thread to wait
+ *
+ * If *@addr is equal to @expected, block the calling thread until another
+ * thread wakes it up with uthread_unpark() on @addr. Checking the value and
+ * starting to wait is atomic with regard to other threads, so a wakeup cannot
+ * be missed between the caller reading *@addr and calling this function.
+ *
+ * This function is a cancellation point (see uthread_cancel()).
+ *
+ * Return: -1 if @addr is NULL or if *@addr was not equal to @expected, in which
+ * case the caller did not wait. 0 once the caller has been woken up.
+ */
+int uthread_park(int *addr, int expected);
+
+/*
+ * uthread_unpark - Wake threads waiting on an address
+ * @addr: Address the threads are waiting on
+ * @count: Maximum number of threads to wake up
+ *
+ * Wake up to @count of the threads waiting on @addr, oldest first.
+ *
+ * Return: -1 if @addr is NULL or if @count is negative. Number of threads woken
+ * up otherwise.
+ */
+int uthread_unpark(int *addr, int count);
+
+#endif /* _PARK_H */
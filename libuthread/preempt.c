@@ -1,27 +1,165 @@
+#include <limits.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <signal.h>
+#include <time.h>
 #include <unistd.h>
 #include <sys/time.h>
 #include <pthread.h>
 #include <errno.h>
 #include <string.h>
 #include "private.h"
-#include "preempt.h"
 
 /* Global variables to hold the previous signal handler and the timer settings */
 static struct sigaction old_sigaction;
 static struct itimerval old_timer;
 
+/* Time slice given to each thread, in microseconds (100 Hz) */
+#define PREEMPT_QUANTUM_USEC 10000
+
+/* Maximum number of safe-points crossed between two reads of the clock */
+#define SAFEPOINT_STRIDE 256
+
+/* Target interval between two reads of the clock, in nanoseconds */
+#define SAFEPOINT_CHECK_NSEC (PREEMPT_QUANTUM_USEC * 1000ull / 10)
+
+/* Whether signal-based preemption was requested when starting the library */
+static bool preempt_active;
+
+/*
+ * Kernel thread running the threads, the only one to act on the alarm or at
+ * safe-points
+ */
+static pthread_t preempt_owner;
+
+/* Whether safe-point preemption was requested when starting the library */
+static bool safepoint_active;
+
+/* End of the current thread's time slice */
+static uint64_t safepoint_deadline;
+
+/*
+ * Time of the last clock read, and number of safe-points to cross before the
+ * next one. The stride adapts to how often the code reaches safe-points, so
+ * that the time slice is not overrun by more than about SAFEPOINT_CHECK_NSEC.
+ */
+static uint64_t safepoint_last;
+static int safepoint_stride = SAFEPOINT_STRIDE;
+
+/*
+ * Per kernel thread, so that other kernel threads running instrumented code
+ * neither disturb the countdown of the threads' kernel thread nor reach the
+ * slow path more than once every INT_MAX safe-points.
+ */
+_Thread_local int uthread_safepoint_countdown = INT_MAX;
+
 /* Signal handler for SIGVTALRM (used for preemption) */
 void preempt_handler(int sig) {
-    uthread_yield();  // Yield the current thread
+    (void)sig;
+
+    /*
+     * The alarm is process-directed, so the kernel may deliver it to any
+     * kernel thread not blocking it (see sem_up_remote()). Only the one
+     * running the threads can be preempted.
+     */
+    if (!pthread_equal(pthread_self(), preempt_owner)) {
+        return;
+    }
+
+    TRACE(TRACE_PREEMPT, uthread_self(), 0);
+    uthread_preempt();  // Yield the current thread
+}
+
+/*
+ * Monotonic clock in nanoseconds, read from the vDSO without a system call. The
+ * coarse clock would be cheaper, but its resolution (a few milliseconds) is too
+ * low to tell how long a stride of safe-points takes.
+ */
+static uint64_t safepoint_clock(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+/* Slow path of uthread_maybe_yield(), taken every safepoint_stride calls */
+void uthread_safepoint(void) {
+    uint64_t now, elapsed, stride;
+
+    // Only the threads' kernel thread has a slice to enforce
+    if (!safepoint_active || !pthread_equal(pthread_self(), preempt_owner)) {
+        uthread_safepoint_countdown = INT_MAX;
+        return;
+    }
+
+    // Scale the stride so that the next stride takes about SAFEPOINT_CHECK_NSEC
+    now = safepoint_clock();
+    elapsed = now - safepoint_last;
+    stride = elapsed ? (uint64_t)safepoint_stride * SAFEPOINT_CHECK_NSEC / elapsed
+                     : SAFEPOINT_STRIDE;
+    if (stride > (uint64_t)safepoint_stride * 2) {
+        stride = (uint64_t)safepoint_stride * 2;
+    }
+    if (stride > SAFEPOINT_STRIDE) {
+        stride = SAFEPOINT_STRIDE;
+    }
+    safepoint_stride = stride ? (int)stride : 1;
+    safepoint_last = now;
+    uthread_safepoint_countdown = safepoint_stride;
+
+    if (now >= safepoint_deadline) {
+        // Start a new slice, in case no other thread is ready to take over
+        safepoint_deadline = now + PREEMPT_QUANTUM_USEC * 1000ull;
+        TRACE(TRACE_PREEMPT, uthread_self(), 0);
+        uthread_preempt();
+    }
+}
+
+#ifdef UTHREAD_SAFEPOINT_HOOKS
+/*
+ * Entry hook inserted by -finstrument-functions, so that code built with that
+ * flag gets a safe-point at every function call without being modified.
+ */
+__attribute__((no_instrument_function))
+void __cyg_profile_func_enter(void *func, void *call_site) {
+    (void)func;
+    (void)call_site;
+    uthread_maybe_yield();
+}
+
+__attribute__((no_instrument_function))
+void __cyg_profile_func_exit(void *func, void *call_site) {
+    (void)func;
+    (void)call_site;
+}
+#endif
+
+/* Function to restart the time slice of the thread being switched in */
+void preempt_quantum_start() {
+    if (safepoint_active) {
+        safepoint_last = safepoint_clock();
+        safepoint_deadline = safepoint_last + PREEMPT_QUANTUM_USEC * 1000ull;
+        uthread_safepoint_countdown = safepoint_stride;
+    }
 }
 
 /* Function to start preemption */
-void preempt_start() {
+void preempt_start(int mode) {
     struct sigaction sa;
 
+    if (mode == UTHREAD_PREEMPT_SAFEPOINT) {
+        safepoint_active = true;
+        preempt_owner = pthread_self();
+        preempt_quantum_start();
+        return;
+    }
+    if (mode != UTHREAD_PREEMPT_SIGNAL) {
+        return;
+    }
+    preempt_active = true;
+    preempt_owner = pthread_self();
+
     // Set up the signal handler
     memset(&sa, 0, sizeof(struct sigaction));
     sa.sa_handler = preempt_handler;
@@ -36,9 +174,9 @@ void preempt_start() {
     // Set up the timer to trigger SIGVTALRM 100 times per second
     struct itimerval timer;
     timer.it_value.tv_sec = 0;
-    timer.it_value.tv_usec = 10000;  // 10 milliseconds = 100 Hz
+    timer.it_value.tv_usec = PREEMPT_QUANTUM_USEC;  // 10 milliseconds = 100 Hz
     timer.it_interval.tv_sec = 0;
-    timer.it_interval.tv_usec = 10000;
+    timer.it_interval.tv_usec = PREEMPT_QUANTUM_USEC;
 
     // Set the timer to send SIGVTALRM
     setitimer(ITIMER_VIRTUAL, &timer, &old_timer);
@@ -46,6 +184,14 @@ void preempt_start() {
 
 /* Function to stop preemption */
 void preempt_stop() {
+    safepoint_active = false;
+    uthread_safepoint_countdown = INT_MAX;
+
+    if (!preempt_active) {
+        return;
+    }
+    preempt_active = false;
+
     // Restore the original signal handler
     sigaction(SIGVTALRM, &old_sigaction, NULL);
 
@@ -56,15 +202,23 @@ void preempt_stop() {
 /* Function to enable preemption by blocking the SIGVTALRM signal */
 void preempt_enable() {
     sigset_t mask;
+
+    if (!preempt_active) {
+        return;
+    }
     sigemptyset(&mask);
     sigaddset(&mask, SIGVTALRM);
-    sigprocmask(SIG_UNBLOCK, &mask, NULL);  // Unblock the SIGVTALRM signal
+    pthread_sigmask(SIG_UNBLOCK, &mask, NULL);  // Unblock the SIGVTALRM signal
 }
 
 /* Function to disable preemption by blocking the SIGVTALRM signal */
 void preempt_disable() {
     sigset_t mask;
+
+    if (!preempt_active) {
+        return;
+    }
     sigemptyset(&mask);
     sigaddset(&mask, SIGVTALRM);
-    sigprocmask(SIG_BLOCK, &mask, NULL);  // Block the SIGVTALRM signal
+    pthread_sigmask(SIG_BLOCK, &mask, NULL);  // Block the SIGVTALRM signal
 }
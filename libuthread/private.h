@@ -53,14 +53,74 @@ void uthread_ctx_destroy_stack(void *top_of_stack);
  * @uctx: Pointer to thread context to initialize
  * @top_of_stack: Pointer to the top of a valid stack segment, as allocated by
  *	uthread_ctx_alloc_stack()
+ * @reserve: Number of bytes at the start of the stack segment that are kept
+ *	out of the thread's stack, at most half the segment
  * @func: Function to be executed by the thread
  * @arg: Argument to pass to the thread
  *
  * Return: 0 if @uctx was properly initialized, or -1 in case of failure
  */
-int uthread_ctx_init(uthread_ctx_t *uctx, void *top_of_stack,
+int uthread_ctx_init(uthread_ctx_t *uctx, void *top_of_stack, size_t reserve,
 					 uthread_func_t func, void *arg);
 
+/*
+ * uthread_ctx_shared - Saved state of a shared-stack thread
+ * @buf: Copy of the thread's live stack while another thread owns the stack
+ * @size: Size of the copy held in @buf
+ * @capacity: Allocated size of @buf
+ * @sp: Lowest live stack address of the thread when it was last switched out
+ * @func: Function to be executed by the thread
+ * @arg: Argument to pass to the thread
+ * @started: Whether the thread has been switched in already
+ *
+ * Only meant to be handled by the context API.
+ */
+struct uthread_ctx_shared {
+	char *buf;
+	size_t size;
+	size_t capacity;
+	char *sp;
+	uthread_func_t func;
+	void *arg;
+	int started;
+};
+
+/*
+ * uthread_ctx_init_shared - Initialize a shared-stack thread's execution context
+ * @uctx: Pointer to thread context to initialize
+ * @shared: Pointer to the thread's shared-stack state to initialize
+ * @func: Function to be executed by the thread
+ * @arg: Argument to pass to the thread
+ *
+ * Instead of running on its own stack, the thread will run on a stack shared
+ * with all the other shared-stack threads, and only keep a copy of the part of
+ * that stack it actually uses while other threads run.
+ *
+ * Return: 0 if @uctx was properly initialized, or -1 in case of failure
+ */
+int uthread_ctx_init_shared(uthread_ctx_t *uctx, struct uthread_ctx_shared *shared,
+			    uthread_func_t func, void *arg);
+
+/*
+ * uthread_ctx_destroy_shared - Release a shared-stack thread's saved state
+ * @shared: Pointer to the thread's shared-stack state
+ */
+void uthread_ctx_destroy_shared(struct uthread_ctx_shared *shared);
+
+/*
+ * uthread_ctx_switch_shared - Switch between two execution contexts, either of
+ * which may run on the shared stack
+ * @prev: Pointer to the execution context structure in which to save the
+ *	currently running thread
+ * @prev_shared: Shared-stack state of the running thread, or NULL if it has its
+ *	own stack
+ * @next: Pointer to the execution context structure to resume
+ * @next_shared: Shared-stack state of the thread to resume, or NULL if it has
+ *	its own stack
+ */
+void uthread_ctx_switch_shared(uthread_ctx_t *prev, struct uthread_ctx_shared *prev_shared,
+			       uthread_ctx_t *next, struct uthread_ctx_shared *next_shared);
+
 
 /**
  * Private preemption API
@@ -68,15 +128,19 @@ int uthread_ctx_init(uthread_ctx_t *uctx, void *top_of_stack,
 
 /*
  * preempt_start - Start thread preemption
- * @preempt: Enable preemption if true
+ * @mode: Preemption mode, one of the UTHREAD_PREEMPT_* values
+ *
+ * With UTHREAD_PREEMPT_SIGNAL, configure a timer that must fire a virtual alarm
+ * at a frequency of 100 Hz and setup a timer handler that forcefully yields the
+ * currently running thread.
  *
- * Configure a timer that must fire a virtual alarm at a frequency of 100 Hz and
- * setup a timer handler that forcefully yields the currently running thread.
+ * With UTHREAD_PREEMPT_SAFEPOINT, no signal is used: the running thread yields
+ * from uthread_maybe_yield() once it has used up its 10 ms time slice.
  *
- * If @preempt is false, don't start preemption; all the other functions from
- * the preemption API should then be ineffective.
+ * With UTHREAD_PREEMPT_NONE, don't start preemption; all the other functions
+ * from the preemption API should then be ineffective.
  */
-void preempt_start(bool preempt);
+void preempt_start(int mode);
 
 /*
  * preempt_stop - Stop thread preemption
@@ -86,6 +150,14 @@ void preempt_start(bool preempt);
  */
 void preempt_stop(void);
 
+/*
+ * preempt_quantum_start - Start a new time slice
+ *
+ * To be called whenever a thread is switched in, so that safe-point preemption
+ * measures the time slice of that thread.
+ */
+void preempt_quantum_start(void);
+
 /*
  * preempt_enable - Enable preemption
  */
@@ -116,13 +188,277 @@ struct uthread_tcb *uthread_current(void);
 
 /*
  * uthread_block - Block currently running thread
+ *
+ * Must be called with preemption disabled, which is still the case when the
+ * thread resumes.
  */
 void uthread_block(void);
 
+/*
+ * uthread_wait_cancel_t - Wait cancellation function type
+ * @uthread: TCB of the blocked thread being cancelled
+ * @arg: Argument given to uthread_block_cancelable()
+ *
+ * Function removing @uthread from the wait queue it was put in before calling
+ * uthread_block_cancelable().
+ */
+typedef void (*uthread_wait_cancel_t)(struct uthread_tcb *uthread, void *arg);
+
+/*
+ * uthread_block_cancelable - Block currently running thread, unless cancelled
+ * @cancel: Function to take the thread out of its wait queue if it gets
+ *	cancelled while blocked
+ * @arg: Argument to pass to @cancel
+ *
+ * Like uthread_block(), but the wait is aborted if the thread is cancelled,
+ * in which case @cancel is called first. The caller should then re-enable
+ * preemption and call uthread_testcancel().
+ *
+ * Return: 0 if the thread was unblocked, -1 if the wait was aborted
+ */
+int uthread_block_cancelable(uthread_wait_cancel_t cancel, void *arg);
+
+/*
+ * uthread_preempt - Forcefully yield the running thread
+ *
+ * Like uthread_yield(), but meant to be called on behalf of preemption, and
+ * thus not a cancellation point.
+ */
+void uthread_preempt(void);
+
 /*
  * uthread_unblock - Unblock thread
  * @uthread: TCB of thread to unblock
+ *
+ * Must be called with preemption disabled.
  */
 void uthread_unblock(struct uthread_tcb *uthread);
 
+/*
+ * uthread_unblock_handoff - Unblock thread and switch to it
+ * @uthread: TCB of thread to unblock
+ *
+ * Unblock @uthread and give it the processor right away, instead of putting it
+ * at the end of the ready queue. The calling thread is put back at the end of
+ * the ready queue and resumes once it gets scheduled again.
+ *
+ * Must be called with preemption disabled, which is still the case when the
+ * calling thread resumes.
+ */
+void uthread_unblock_handoff(struct uthread_tcb *uthread);
+
+/*
+ * uthread_waiter - Wait queue entry
+ * @next: Next waiter in the wait queue
+ * @prev: Previous waiter in the wait queue
+ * @addr: Address the thread is waiting on
+ * @uthread: TCB of the waiting thread
+ *
+ * Each TCB embeds one such entry, so that a thread can be put in an intrusive
+ * wait queue without allocating memory (and without relying on its stack,
+ * which is not always addressable while it is blocked).
+ */
+struct uthread_waiter {
+	struct uthread_waiter *next;
+	struct uthread_waiter *prev;
+	const void *addr;
+	struct uthread_tcb *uthread;
+};
+
+/*
+ * uthread_create_detached - Create a thread that is never joined
+ * @func: Function to be executed by the thread
+ * @arg: Argument to be passed to the thread
+ *
+ * Like uthread_create(), but the new thread cannot be joined, and is destroyed
+ * as soon as it has exited, so that its TID can be reused right away.
+ *
+ * Return: TID of the new thread in case of success, (uthread_t)-1 in case of
+ * failure
+ */
+uthread_t uthread_create_detached(uthread_func_t func, void *arg);
+
+/*
+ * uthread_current_waiter - Get the wait queue entry of the running thread
+ *
+ * Return: Pointer to the wait queue entry embedded in the current thread's TCB
+ */
+struct uthread_waiter *uthread_current_waiter(void);
+
+/*
+ * uthread_current_arena - Get the arena of the running thread
+ *
+ * Return: Pointer to the arena embedded in the current thread's TCB
+ */
+struct uthread_arena *uthread_current_arena(void);
+
+/*
+ * uthread_set_worker - Mark the running thread as an executor worker
+ */
+void uthread_set_worker(void);
+
+/*
+ * uthread_is_worker - Tell whether the running thread is an executor worker
+ *
+ * Return: 1 if the running thread was marked with uthread_set_worker(), 0
+ * otherwise
+ */
+int uthread_is_worker(void);
+
+
+/**
+ * Private inbox API
+ */
+#include <stdatomic.h>
+
+/*
+ * uthread_inbox_node - Inbox entry
+ * @next: Link to the next entry, only managed by the inbox
+ * @func: Function run by the scheduler when the entry is received
+ *
+ * Entries are meant to be embedded into the object they notify about, so that
+ * posting never needs to allocate memory. An entry must not be posted again
+ * before its @func has been called.
+ */
+struct uthread_inbox_node {
+	struct uthread_inbox_node *_Atomic next;
+	void (*func)(struct uthread_inbox_node *node);
+};
+
+/*
+ * uthread_inbox_init - Initialize the scheduler's inbox
+ *
+ * Return: 0 in case of success, -1 if the wakeup event could not be created
+ */
+int uthread_inbox_init(void);
+
+/*
+ * uthread_inbox_fini - Release the scheduler's inbox
+ *
+ * Wait for the posters that may still be writing to the wakeup event, then
+ * close it. Entries still pending are not dropped.
+ */
+void uthread_inbox_fini(void);
+
+/*
+ * uthread_inbox_post - Post an entry to the scheduler
+ * @node: Entry to post
+ *
+ * This function is wait-free and can be called from any kernel thread. It wakes
+ * the scheduler up if it is sleeping in uthread_inbox_wait(). Entries posted
+ * once the inbox has been released are kept, and run after the inbox is
+ * initialized again, so @node must stay valid until then.
+ */
+void uthread_inbox_post(struct uthread_inbox_node *node);
+
+/*
+ * uthread_inbox_drain - Run the entries posted to the scheduler
+ *
+ * Only to be called from the scheduler's kernel thread, with preemption
+ * disabled.
+ */
+void uthread_inbox_drain(void);
+
+/*
+ * uthread_inbox_wait - Sleep until an entry is posted to the scheduler
+ *
+ * Return immediately if entries are already pending. Only to be called from the
+ * scheduler's kernel thread, with preemption disabled.
+ */
+void uthread_inbox_wait(void);
+
+
+/**
+ * Private trace API
+ */
+#include <stdint.h>
+
+/*
+ * Trace event types
+ *
+ * TRACE_SWITCH: @tid was switched in, in place of thread @arg
+ * TRACE_CREATE: @tid created thread @arg
+ * TRACE_EXIT: @tid exited
+ * TRACE_BLOCK: @tid blocked on the object of address @arg (or on the thread of
+ *	TID @arg when joining)
+ * TRACE_UNBLOCK: @tid was unblocked by thread @arg
+ * TRACE_PREEMPT: @tid was forced to yield by the preemption timer or at a
+ *	safe-point
+ */
+#define TRACE_SWITCH	0
+#define TRACE_CREATE	1
+#define TRACE_EXIT	2
+#define TRACE_BLOCK	3
+#define TRACE_UNBLOCK	4
+#define TRACE_PREEMPT	5
+
+/* Whether the tracer is currently recording */
+extern bool uthread_trace_on;
+
+/*
+ * trace_record - Record an event in the trace buffer
+ * @type: Event type, one of the TRACE_* values
+ * @tid: Thread the event is about
+ * @arg: Event argument, depending on @type
+ *
+ * Use TRACE() instead, which does nothing unless the tracer is enabled.
+ */
+void trace_record(int type, uint64_t tid, uint64_t arg);
+
+#define TRACE(type, tid, arg)						\
+do {									\
+	if (__builtin_expect(uthread_trace_on, 0))			\
+		trace_record((type), (uint64_t)(tid), (uint64_t)(arg));	\
+} while (0)
+
+
+/**
+ * Private arena API
+ */
+
+struct uthread_arena_chunk;
+
+/*
+ * uthread_arena - Per-thread bump allocator, embedded in each TCB
+ * @cur: Next free byte of the current region
+ * @end: End of the current region
+ * @chunks: Chunks owned by the arena, most recent first
+ * @region: Initial region, not owned by the arena (may be NULL)
+ * @region_end: End of the initial region
+ */
+struct uthread_arena {
+	char *cur;
+	char *end;
+	struct uthread_arena_chunk *chunks;
+	char *region;
+	char *region_end;
+};
+
+/*
+ * uthread_arena_init - Initialize an arena
+ * @arena: Arena to initialize
+ * @region: Memory region to allocate from first, not owned by the arena (may
+ *	be NULL)
+ * @size: Size of @region
+ */
+void uthread_arena_init(struct uthread_arena *arena, void *region, size_t size);
+
+/*
+ * uthread_arena_release - Release all the memory of an arena
+ * @arena: Arena to release
+ *
+ * Chunks go back to the global pool, and the arena goes back to allocating
+ * from its initial region. It can be released again. Must be called with
+ * preemption disabled.
+ */
+void uthread_arena_release(struct uthread_arena *arena);
+
+/*
+ * uthread_arena_stack_reserve - Get the size of the arena region of new stacks
+ *
+ * Return: Number of bytes to reserve at the low end of the stack of new
+ * threads for their arena, as set by uthread_arena_set_stack_reserve()
+ */
+size_t uthread_arena_stack_reserve(void);
+
 #endif /* _UTHREAD_PRIVATE_H */
@@ -4,17 +4,15 @@
 #include <stdio.h>
 
 #include "queue.h"
-typedef struct queue_node* queue_node_t;
+#include "typed_queue.h"
 
-struct queue_node {
-    void* data;
-    struct queue_node* next;
-};
+/* queue_t is the instantiation of the generic queue holding void pointers */
+DEFINE_QUEUE(ptr_queue, void *)
+
+typedef struct ptr_queue_node* queue_node_t;
 
 struct queue {
-    struct queue_node* front;
-    struct queue_node* back;
-    int length;
+    struct ptr_queue items;
 };
 
 queue_t queue_create(void)
@@ -24,19 +22,18 @@ queue_t queue_create(void)
 		return NULL;
     }
 
-	my_queue->front = NULL;
-	my_queue->back = NULL;
-	my_queue->length = 0;
+	ptr_queue_init(&my_queue->items);
 
 	return my_queue;
 }
 
 int queue_destroy(queue_t queue)
 {
-	if (queue == NULL || queue->length != 0) {
+	if (queue == NULL || queue->items.length != 0) {
         return -1;
     }
 
+    ptr_queue_fini(&queue->items);
     free(queue);
     queue = NULL;
 
@@ -49,72 +46,124 @@ int queue_enqueue(queue_t queue, void *data)
         return -1;
     }
 
-    queue_node_t my_queue_node = (queue_node_t)malloc(sizeof(struct queue_node));
-    if (my_queue_node == NULL) {
-        return -1;
+    return ptr_queue_enqueue(&queue->items, data);
+}
+
+int queue_dequeue(queue_t queue, void **data)
+{
+	if (queue == NULL || data == NULL) {
+		return -1;
 	}
-	
-	my_queue_node->data = data;
-    my_queue_node->next = NULL;
 
-    if (queue->length == 0) {
-        queue->front = my_queue_node;
-        queue->back = my_queue_node;    
-    } else {
-        queue->back->next = my_queue_node;
-        queue->back = my_queue_node;
-    }
-    queue->length++;
-	
+	return ptr_queue_dequeue(&queue->items, data);
+}
+
+int queue_enqueue_batch(queue_t queue, void **data, int count)
+{
+	queue_node_t first = NULL, last = NULL;
+	int i;
+
+	if (queue == NULL || data == NULL || count < 0) {
+		return -1;
+	}
+
+	// Build the chain aside, so that the queue is left untouched on failure
+	for (i = 0; i < count; i++) {
+		queue_node_t node;
+
+		if (data[i] == NULL ||
+		    (node = ptr_queue_node_alloc(&queue->items)) == NULL) {
+			while (first != NULL) {
+				queue_node_t next = first->next;
+				ptr_queue_node_free(&queue->items, first);
+				first = next;
+			}
+			return -1;
+		}
+
+		node->item = data[i];
+		node->next = NULL;
+		node->prev = last;
+		if (last == NULL) {
+			first = node;
+		} else {
+			last->next = node;
+		}
+		last = node;
+	}
+
+	if (count == 0) {
+		return 0;
+	}
+
+	first->prev = queue->items.back;
+	if (queue->items.length == 0) {
+		queue->items.front = first;
+	} else {
+		queue->items.back->next = first;
+	}
+	queue->items.back = last;
+	queue->items.length += count;
+
 	return 0;
 }
 
-int queue_dequeue(queue_t queue, void **data)
+int queue_dequeue_batch(queue_t queue, void **data, int count)
 {
-	if (queue == NULL || data == NULL || queue->length == 0) {
+	int i;
+
+	if (queue == NULL || data == NULL || count < 0) {
+		return -1;
+	}
+
+	for (i = 0; i < count; i++) {
+		if (ptr_queue_dequeue(&queue->items, &data[i])) {
+			break;
+		}
+	}
+
+	return i;
+}
+
+int queue_splice(queue_t dest, queue_t src)
+{
+	if (dest == NULL || src == NULL || dest == src) {
 		return -1;
 	}
-	
-	*data = queue->front->data;
-	queue_node_t temp = queue->front;
-	queue->front = queue->front->next;
 
-	if (queue->front == NULL) {
-		queue->back = NULL;
+	if (src->items.length == 0) {
+		return 0;
 	}
 
-	queue->length--;
+	src->items.front->prev = dest->items.back;
+	if (dest->items.length == 0) {
+		dest->items.front = src->items.front;
+	} else {
+		dest->items.back->next = src->items.front;
+	}
+	dest->items.back = src->items.back;
+	dest->items.length += src->items.length;
 
-	free(temp);
+	src->items.front = NULL;
+	src->items.back = NULL;
+	src->items.length = 0;
 
 	return 0;
 }
 
 int queue_delete(queue_t queue, void *data)
 {
-	if (queue == NULL || data == NULL || queue->length == 0) {
+	if (queue == NULL || data == NULL || queue->items.length == 0) {
 		return -1;
 	}
 
-	queue_node_t current = queue->front;
-	queue_node_t prev = NULL;
+	queue_node_t current = queue->items.front;
 
 	while (current != NULL) {
-		if (current->data == data) {
-			if (prev == NULL) { // deleting front
-				queue->front = current->next;
-				if (queue->back == current)
-					queue->back = NULL;
-			} else {
-				prev->next = current->next;
-				if (queue->back == current)
-					queue->back = prev;
-			}
-			free(current);
-			queue->length--;
+		if (current->item == data) {
+			ptr_queue_remove(&queue->items, current);
 			return 0;
 		}
-		prev = current;
 		current = current->next;
 	}
 	return -1; // not found
@@ -126,20 +175,42 @@ int queue_iterate(queue_t queue, queue_func_t func)
 		return -1;
 	}
 
-	queue_node_t current = queue->front;
+	queue_node_t current = queue->items.front;
 	while (current != NULL) {
 		queue_node_t next = current->next;
-		func(queue, current->data); // Run the callback
+		func(queue, current->item); // Run the callback
 		current = next;
 	}
 	return 0;
 }
 
+int queue_find(queue_t queue, queue_find_func_t func, void *arg, void **data)
+{
+	if (queue == NULL || func == NULL) {
+		return -1;
+	}
+
+	queue_node_t current = queue->items.front;
+	while (current != NULL) {
+		queue_node_t next = current->next;
+		void *item = current->item;
+
+		if (func(queue, item, arg)) { // Stop here
+			if (data != NULL) {
+				*data = item;
+			}
+			return 0;
+		}
+		current = next;
+	}
+	return -1;
+}
+
 int queue_length(queue_t queue)
 {
 	if (queue == NULL) {
         return -1;
     }
 
-    return queue->length;
+    return queue->items.length;
 }
@@ -8,7 +8,8 @@
  * other.  When dequeueing, the queue must returned the oldest enqueued item
  * first and so on.
  *
- * Apart from delete and iterate operations, all operations should be O(1).
+ * Apart from delete, iterate and find operations, all operations should be
+ * O(1), or O(N) in the number of items moved for batch operations.
  */
 typedef struct queue* queue_t;
 
@@ -58,6 +59,49 @@ int queue_enqueue(queue_t queue, void *data);
  */
 int queue_dequeue(queue_t queue, void **data);
 
+/*
+ * queue_enqueue_batch - Enqueue several data items
+ * @queue: Queue in which to enqueue items
+ * @data: Array of addresses of data items to enqueue
+ * @count: Number of items in @data
+ *
+ * Enqueue the @count addresses contained in array @data in the queue @queue, in
+ * the order of the array. The items are linked together before being appended
+ * to @queue in one step, so that either all of them or none are enqueued.
+ *
+ * Return: -1 if @queue or @data are NULL, if @count is negative, if one of the
+ * items is NULL, or in case of memory allocation error when enqueing. 0 if all
+ * the items were successfully enqueued in @queue.
+ */
+int queue_enqueue_batch(queue_t queue, void **data, int count);
+
+/*
+ * queue_dequeue_batch - Dequeue several data items
+ * @queue: Queue in which to dequeue items
+ * @data: Array of data pointers where items are received
+ * @count: Maximum number of items to dequeue
+ *
+ * Remove up to @count of the oldest items of queue @queue and assign them to
+ * array @data, oldest first.
+ *
+ * Return: -1 if @queue or @data are NULL, or if @count is negative. Number of
+ * items dequeued otherwise, which is less than @count if @queue ran empty.
+ */
+int queue_dequeue_batch(queue_t queue, void **data, int count);
+
+/*
+ * queue_splice - Move all the items of a queue to the end of another
+ * @dest: Queue receiving the items
+ * @src: Queue giving the items
+ *
+ * Append all the items of queue @src to the end of queue @dest, in their
+ * original order, and leave @src empty. This operation is O(1).
+ *
+ * Return: -1 if @dest or @src are NULL, or if they are the same queue. 0 if
+ * the items were successfully moved.
+ */
+int queue_splice(queue_t dest, queue_t src);
+
 /*
  * queue_delete - Delete data item
  * @queue: Queue in which to delete item
@@ -97,6 +141,40 @@ typedef void (*queue_func_t)(queue_t queue, void *data);
  */
 int queue_iterate(queue_t queue, queue_func_t func);
 
+/*
+ * queue_find_func_t - Queue search callback function type
+ * @queue: Queue to which item belongs
+ * @data: Data item
+ * @arg: Extra argument given to queue_find()
+ *
+ * Function to be run on items using queue_find(). The current item is received
+ * as @data.
+ *
+ * Return: 0 to continue with the next item, any other value to stop at the
+ * current item.
+ */
+typedef int (*queue_find_func_t)(queue_t queue, void *data, void *arg);
+
+/*
+ * queue_find - Search a queue
+ * @queue: Queue to search
+ * @func: Function to call on each queue item
+ * @arg: Extra argument to pass to @func
+ * @data: Address of data pointer where the item is received (can be NULL)
+ *
+ * This function iterates through the items in the queue @queue, from the oldest
+ * item to the newest item, and calls the given callback function @func on each
+ * item, along with @arg, until @func returns a non-zero value. If @data is not
+ * NULL, it then receives the item at which the iteration stopped.
+ *
+ * Like queue_iterate(), this function is resistant to the current item being
+ * deleted as part of the iteration (ie in @func).
+ *
+ * Return: -1 if @queue or @func are NULL, or if @func never returned a
+ * non-zero value. 0 if the iteration was stopped by @func.
+ */
+int queue_find(queue_t queue, queue_find_func_t func, void *arg, void **data);
+
 /*
  * queue_length - Queue length
  * @queue: Queue to get the length of
@@ -1,3 +1,5 @@
+#include <stdatomic.h>
+#include <stdbool.h>
 #include <stddef.h>
 #include <stdlib.h>
 
@@ -9,8 +11,15 @@
 struct semaphore {
     size_t count;             // The count of available resources
     queue_t waiting_threads;  // A queue of threads waiting for the semaphore
+
+    // Releases made from other kernel threads, applied by the scheduler
+    struct uthread_inbox_node remote;
+    atomic_size_t remote_ups;
+    atomic_bool remote_posted;
 };
 
+static void sem_remote_receive(struct uthread_inbox_node *node);
+
 
 sem_t sem_create(size_t count) {
     // Allocate memory for the semaphore
@@ -21,14 +30,21 @@ sem_t sem_create(size_t count) {
 
     // Initialize semaphore fields
     sem->count = count;
-    sem->waiting_threads = queue_create();  // Assuming you have a queue API
+    sem->remote.func = sem_remote_receive;
+    atomic_init(&sem->remote_ups, 0);
+    atomic_init(&sem->remote_posted, false);
+    sem->waiting_threads = queue_create();
+    if (sem->waiting_threads == NULL) {
+        free(sem);
+        return NULL;
+    }
 
     return sem;
 }
 
 
 int sem_destroy(sem_t sem) {
-    if (sem == NULL || !queue_empty(sem->waiting_threads)) {
+    if (sem == NULL || queue_length(sem->waiting_threads) != 0) {
         return -1;  // Semaphore is NULL or there are waiting threads
     }
 
@@ -41,34 +57,113 @@ int sem_destroy(sem_t sem) {
 }
 
 
+/* Take a cancelled waiter out of the waiting queue */
+static void sem_cancel_wait(struct uthread_tcb *uthread, void *arg) {
+    sem_t sem = (sem_t)arg;
+
+    queue_delete(sem->waiting_threads, uthread);
+}
+
+
 int sem_down(sem_t sem) {
     if (sem == NULL) {
         return -1;  // Semaphore is NULL
     }
 
-    // Decrease the semaphore count
-    sem->count--;
+    uthread_testcancel();
 
-    // If the count is less than 0, add the current thread to the waiting queue
-    if (sem->count < 0) {
-        thread_block(sem->waiting_threads);  // Block the current thread
+    preempt_disable();
+
+    // Wait in line while no resource is available
+    while (sem->count == 0) {
+        queue_enqueue(sem->waiting_threads, uthread_current());
+        TRACE(TRACE_BLOCK, uthread_self(), (uintptr_t)sem);
+        if (uthread_block_cancelable(sem_cancel_wait, sem)) {
+            preempt_enable();
+            uthread_testcancel();
+        }
     }
 
+    // Take the resource
+    sem->count--;
+
+    preempt_enable();
+
     return 0;
 }
 
 
-int sem_up(sem_t sem) {
+/*
+ * Release a resource and wake up the oldest waiter, if any. The waiter either
+ * goes to the back of the ready queue, or gets the processor right away when
+ * @handoff is set.
+ */
+static int sem_release(sem_t sem, int handoff) {
+    struct uthread_tcb *waiter;
+
     if (sem == NULL) {
         return -1;  // Semaphore is NULL
     }
 
+    preempt_disable();
+
     // Increment the semaphore count
     sem->count++;
 
     // If there are threads waiting, unblock the first one
-    if (sem->count <= 0) {
-        thread_unblock(sem->waiting_threads);  // Unblock the oldest thread
+    if (queue_dequeue(sem->waiting_threads, (void **)&waiter) == 0) {
+        if (handoff) {
+            uthread_unblock_handoff(waiter);
+        } else {
+            uthread_unblock(waiter);
+        }
+    }
+
+    preempt_enable();
+
+    return 0;
+}
+
+
+int sem_up(sem_t sem) {
+    return sem_release(sem, 0);
+}
+
+
+int sem_up_handoff(sem_t sem) {
+    return sem_release(sem, 1);
+}
+
+
+/*
+ * Apply the releases made by other kernel threads. Called by the scheduler,
+ * with preemption disabled.
+ */
+static void sem_remote_receive(struct uthread_inbox_node *node) {
+    sem_t sem = (sem_t)((char *)node - offsetof(struct semaphore, remote));
+    struct uthread_tcb *waiter;
+    size_t ups;
+
+    // Clear the flag first, so that later releases post the node again
+    atomic_store(&sem->remote_posted, false);
+    ups = atomic_exchange(&sem->remote_ups, 0);
+
+    sem->count += ups;
+    while (ups-- > 0 && queue_dequeue(sem->waiting_threads, (void **)&waiter) == 0) {
+        uthread_unblock(waiter);
+    }
+}
+
+
+int sem_up_remote(sem_t sem) {
+    if (sem == NULL) {
+        return -1;  // Semaphore is NULL
+    }
+
+    // Only the first release since the last drain needs to notify the scheduler
+    atomic_fetch_add(&sem->remote_ups, 1);
+    if (!atomic_exchange(&sem->remote_posted, true)) {
+        uthread_inbox_post(&sem->remote);
     }
 
     return 0;
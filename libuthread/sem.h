@@ -46,6 +46,8 @@ int sem_destroy(sem_t sem);
  * Taking an unavailable semaphore will cause the caller thread to be blocked
  * until the semaphore becomes available.
  *
+ * This function is a cancellation point (see uthread_cancel()).
+ *
  * Return: -1 if @sem is NULL. 0 if semaphore was successfully taken.
  */
 int sem_down(sem_t sem);
@@ -64,4 +66,43 @@ int sem_down(sem_t sem);
  */
 int sem_up(sem_t sem);
 
+/*
+ * sem_up_handoff - Release a semaphore and hand the processor to its waiter
+ * @sem: Semaphore to release
+ *
+ * Release a resource to semaphore @sem, like sem_up().
+ *
+ * If a thread was waiting on @sem, it is unblocked and switched to directly
+ * instead of being put at the end of the ready queue, so that it can consume
+ * the resource while the data it protects is still hot. The calling thread is
+ * put back at the end of the ready queue.
+ *
+ * Return: -1 if @sem is NULL. 0 if semaphore was successfully released.
+ */
+int sem_up_handoff(sem_t sem);
+
+/*
+ * sem_up_remote - Release a semaphore from another kernel thread
+ * @sem: Semaphore to release
+ *
+ * Release a resource to semaphore @sem, like sem_up(), but from a kernel thread
+ * other than the one running the threads (e.g. a pthread doing I/O). This
+ * function takes no lock and never blocks: the release is handed to the
+ * scheduler, which applies it at its next scheduling point, waking it up first
+ * if it was idle.
+ *
+ * @sem must not be destroyed while releases made with this function may still
+ * be pending. Pending releases are applied by uthread_stop(), and releases made
+ * once it has been called are applied when the library is started again.
+ *
+ * With UTHREAD_PREEMPT_SIGNAL preemption, the calling kernel thread should
+ * block SIGVTALRM (e.g., with pthread_sigmask()), which is best done before
+ * creating it so that it inherits the mask. Otherwise, the kernel may deliver
+ * the preemption alarm to it instead of to the threads' kernel thread, and that
+ * time slice is not enforced.
+ *
+ * Return: -1 if @sem is NULL. 0 if semaphore was successfully released.
+ */
+int sem_up_remote(sem_t sem);
+
 #endif /* _SEMAPHORE_H */
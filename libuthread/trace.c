@@ -0,0 +1,175 @@
+#include <inttypes.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "private.h"
+#include "trace.h"
+
+/* Number of events held in the ring buffer (must be a power of 2) */
+#define TRACE_BUFFER_EVENTS (1 << 16)
+
+/* Fixed-size binary event, as recorded on the hot path */
+struct trace_event {
+    uint64_t ts;
+    uint64_t tid;
+    uint64_t arg;
+    uint32_t type;
+    uint32_t pad;
+};
+
+static struct trace_event trace_buffer[TRACE_BUFFER_EVENTS];
+static atomic_uint_fast64_t trace_next;
+
+bool uthread_trace_on;
+
+/* Reference points to convert timestamps into nanoseconds when dumping */
+static uint64_t trace_start_ts;
+static uint64_t trace_start_ns;
+
+static uint64_t trace_clock_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+/* Raw timestamp: the TSC where available, nanoseconds otherwise */
+static inline uint64_t trace_clock(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return trace_clock_ns();
+#endif
+}
+
+void trace_record(int type, uint64_t tid, uint64_t arg)
+{
+    /*
+     * Claiming the slot atomically keeps the buffer consistent even if a
+     * preemption signal records an event in the middle of this one.
+     */
+    uint64_t slot = atomic_fetch_add_explicit(&trace_next, 1, memory_order_relaxed);
+    struct trace_event *e = &trace_buffer[slot & (TRACE_BUFFER_EVENTS - 1)];
+
+    e->ts = trace_clock();
+    e->tid = tid;
+    e->arg = arg;
+    e->type = (uint32_t)type;
+}
+
+void uthread_trace_enable(void)
+{
+    atomic_store(&trace_next, 0);
+    trace_start_ns = trace_clock_ns();
+    trace_start_ts = trace_clock();
+    uthread_trace_on = true;
+}
+
+void uthread_trace_disable(void)
+{
+    uthread_trace_on = false;
+}
+
+static const char *trace_event_name(uint32_t type)
+{
+    switch (type) {
+    case TRACE_CREATE:
+        return "create";
+    case TRACE_EXIT:
+        return "exit";
+    case TRACE_BLOCK:
+        return "block";
+    case TRACE_UNBLOCK:
+        return "unblock";
+    case TRACE_PREEMPT:
+        return "preempt";
+    default:
+        return "unknown";
+    }
+}
+
+int uthread_trace_dump(const char *path)
+{
+    bool was_on = uthread_trace_on;
+    uint64_t end, first, i;
+    uint64_t end_ts, end_ns;
+    double ns_per_tick;
+    uint64_t last_switch_ts, last_tid = 0;
+    bool have_switch = false;
+    const char *sep = "";
+    FILE *f;
+
+    if (path == NULL) {
+        return -1;
+    }
+
+    f = fopen(path, "w");
+    if (f == NULL) {
+        return -1;
+    }
+
+    // Stop recording so that the buffer does not move under our feet
+    preempt_disable();
+    uthread_trace_on = false;
+
+    end = atomic_load(&trace_next);
+    first = end > TRACE_BUFFER_EVENTS ? end - TRACE_BUFFER_EVENTS : 0;
+
+    end_ns = trace_clock_ns();
+    end_ts = trace_clock();
+    // Before the first switch, the running thread has been running all along
+    last_switch_ts = first == 0 ? trace_start_ts :
+        trace_buffer[first & (TRACE_BUFFER_EVENTS - 1)].ts;
+
+    ns_per_tick = end_ts > trace_start_ts ?
+        (double)(end_ns - trace_start_ns) / (double)(end_ts - trace_start_ts) : 1.0;
+
+    fprintf(f, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+    for (i = first; i < end; i++) {
+        struct trace_event *e = &trace_buffer[i & (TRACE_BUFFER_EVENTS - 1)];
+        double us = (double)(e->ts - trace_start_ts) * ns_per_tick / 1000.0;
+
+        if (e->type == TRACE_SWITCH) {
+            /*
+             * Only one thread runs at a time, so the thread being switched out
+             * has been running since the previous switch.
+             */
+            if (!have_switch || last_tid == e->arg) {
+                double start = (double)(last_switch_ts - trace_start_ts) * ns_per_tick / 1000.0;
+
+                fprintf(f, "%s\n{\"name\":\"running\",\"ph\":\"X\",\"pid\":1,"
+                        "\"tid\":%" PRIu64 ",\"ts\":%.3f,\"dur\":%.3f}",
+                        sep, e->arg, start, us - start);
+                sep = ",";
+            }
+            have_switch = true;
+            last_switch_ts = e->ts;
+            last_tid = e->tid;
+            continue;
+        }
+
+        fprintf(f, "%s\n{\"name\":\"%s\",\"ph\":\"i\",\"s\":\"t\",\"pid\":1,"
+                "\"tid\":%" PRIu64 ",\"ts\":%.3f,\"args\":{\"arg\":%" PRIu64 "}}",
+                sep, trace_event_name(e->type), e->tid, us, e->arg);
+        sep = ",";
+    }
+    fprintf(f, "\n]}\n");
+
+    uthread_trace_on = was_on;
+    preempt_enable();
+
+    if (fclose(f)) {
+        return -1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,41 @@
+#ifndef _UTHREAD_TRACE_H
+#define _UTHREAD_TRACE_H
+
+/*
+ * Scheduler event tracer
+ *
+ * The tracer is always compiled in, and records every scheduling event (thread
+ * creation and exit, context switches, blocking, unblocking and preemption)
+ * into a preallocated ring buffer once enabled. When the buffer is full, the
+ * oldest events are overwritten, so the buffer always holds the most recent
+ * history. While disabled, each event point costs a single test.
+ */
+
+/*
+ * uthread_trace_enable - Start recording scheduler events
+ *
+ * Any event previously recorded is discarded.
+ */
+void uthread_trace_enable(void);
+
+/*
+ * uthread_trace_disable - Stop recording scheduler events
+ *
+ * Recorded events are kept until the tracer is enabled again.
+ */
+void uthread_trace_disable(void);
+
+/*
+ * uthread_trace_dump - Write recorded events to a file
+ * @path: Path of the file to write
+ *
+ * Write the events currently held in the ring buffer to file @path, in the
+ * Chrome trace event JSON format, which can be loaded in chrome://tracing or
+ * in the Perfetto UI. Each thread appears as its own track, with a slice for
+ * each period during which it was running.
+ *
+ * Return: -1 if @path is NULL or cannot be written. 0 otherwise.
+ */
+int uthread_trace_dump(const char *path);
+
+#endif /* _UTHREAD_TRACE_H */
@@ -0,0 +1,181 @@
+#ifndef _TYPED_QUEUE_H
+#define _TYPED_QUEUE_H
+
+#include <stdlib.h>
+
+/* Number of free nodes a queue may always keep cached, whatever its length */
+#define TYPED_QUEUE_CACHE_MIN 16
+
+/*
+ * DEFINE_QUEUE - Define a type-specialized queue
+ * @name: Name of the queue type, also used as prefix for its functions
+ * @type: Type of the items held by the queue
+ *
+ * Define a FIFO queue type `struct name` holding items of type @type by value,
+ * along with `static inline` functions operating on it, so that the compiler
+ * can inline and specialize them at each call site:
+ *
+ * - void name_init(struct name *q): initialize empty queue @q
+ * - void name_fini(struct name *q): release all the memory held by queue @q
+ * - int name_enqueue(struct name *q, type item): enqueue @item, return -1 in
+ *   case of memory allocation error, 0 otherwise
+ * - struct name_node *name_enqueue_node(struct name *q, type item): enqueue
+ *   @item, return the node holding it, or NULL in case of memory allocation
+ *   error
+ * - void name_remove(struct name *q, struct name_node *node): take @node, as
+ *   returned by name_enqueue_node(), out of @q in constant time, wherever it is
+ * - int name_dequeue(struct name *q, type *item): dequeue the oldest item into
+ *   @item, return -1 if @q is empty, 0 otherwise
+ * - int name_length(const struct name *q): return the number of items in @q
+ *
+ * Items are stored inline in the queue nodes, so small values such as integers
+ * need no separate allocation. Dequeued nodes are kept in a per-queue cache and
+ * reused by later enqueues, so that a queue in steady state never calls
+ * malloc() or free(). The cache holds no more nodes than the queue currently
+ * holds items (or TYPED_QUEUE_CACHE_MIN, if greater), so that a queue gives the
+ * memory back after a burst. The nodes themselves (`struct name_node`, with fields
+ * `item`, `next` and `prev`) can be walked from `front` to implement slower
+ * operations, in which case nodes taken out of the queue must be given back
+ * with name_node_free(). The `prev` link of the front node is NULL.
+ *
+ * Unlike with queue_t, there is no NULL checking: queues are expected to be
+ * valid objects, typically embedded in a larger structure.
+ */
+#define DEFINE_QUEUE(name, type)					\
+struct name##_node {							\
+	type item;							\
+	struct name##_node *next;					\
+	struct name##_node *prev;					\
+};									\
+									\
+struct name {								\
+	struct name##_node *front;					\
+	struct name##_node *back;					\
+	struct name##_node *cache;					\
+	int cached;							\
+	int length;							\
+};									\
+									\
+static inline void name##_init(struct name *q)				\
+{									\
+	q->front = NULL;						\
+	q->back = NULL;							\
+	q->cache = NULL;						\
+	q->cached = 0;							\
+	q->length = 0;							\
+}									\
+									\
+static inline struct name##_node *name##_node_alloc(struct name *q)	\
+{									\
+	struct name##_node *node = q->cache;				\
+									\
+	if (node != NULL) {						\
+		q->cache = node->next;					\
+		q->cached--;						\
+		return node;						\
+	}								\
+	return (struct name##_node *)malloc(sizeof(*node));		\
+}									\
+									\
+static inline void name##_node_free(struct name *q,			\
+				    struct name##_node *node)		\
+{									\
+	if (q->cached >= TYPED_QUEUE_CACHE_MIN &&			\
+	    q->cached >= q->length) {					\
+		free(node);						\
+		/* Shrink faster than the queue, to catch up with it */	\
+		if (q->cached > TYPED_QUEUE_CACHE_MIN &&		\
+		    q->cached > q->length) {				\
+			node = q->cache;				\
+			q->cache = node->next;				\
+			q->cached--;					\
+			free(node);					\
+		}							\
+		return;							\
+	}								\
+	node->next = q->cache;						\
+	q->cache = node;						\
+	q->cached++;							\
+}									\
+									\
+static inline void name##_fini(struct name *q)				\
+{									\
+	struct name##_node *node, *next;				\
+									\
+	for (node = q->front; node != NULL; node = next) {		\
+		next = node->next;					\
+		free(node);						\
+	}								\
+	for (node = q->cache; node != NULL; node = next) {		\
+		next = node->next;					\
+		free(node);						\
+	}								\
+	name##_init(q);							\
+}									\
+									\
+static inline struct name##_node *name##_enqueue_node(struct name *q,	\
+							type item)	\
+{									\
+	struct name##_node *node = name##_node_alloc(q);		\
+									\
+	if (__builtin_expect(node == NULL, 0))				\
+		return NULL;						\
+									\
+	node->item = item;						\
+	node->next = NULL;						\
+	node->prev = q->back;						\
+	if (q->back == NULL)						\
+		q->front = node;					\
+	else								\
+		q->back->next = node;					\
+	q->back = node;							\
+	q->length++;							\
+									\
+	return node;							\
+}									\
+									\
+static inline int name##_enqueue(struct name *q, type item)		\
+{									\
+	return name##_enqueue_node(q, item) == NULL ? -1 : 0;		\
+}									\
+									\
+static inline int name##_dequeue(struct name *q, type *item)		\
+{									\
+	struct name##_node *node = q->front;				\
+									\
+	if (node == NULL)						\
+		return -1;						\
+									\
+	*item = node->item;						\
+	q->front = node->next;						\
+	if (q->front == NULL)						\
+		q->back = NULL;						\
+	else								\
+		q->front->prev = NULL;					\
+	q->length--;							\
+	name##_node_free(q, node);					\
+									\
+	return 0;							\
+}									\
+									\
+static inline void name##_remove(struct name *q,			\
+				 struct name##_node *node)		\
+{									\
+	if (node->prev == NULL)						\
+		q->front = node->next;					\
+	else								\
+		node->prev->next = node->next;				\
+	if (node->next == NULL)						\
+		q->back = node->prev;					\
+	else								\
+		node->next->prev = node->prev;				\
+	q->length--;							\
+	name##_node_free(q, node);					\
+}									\
+									\
+static inline int name##_length(const struct name *q)			\
+{									\
+	return q->length;						\
+}
+
+#endif /* _TYPED_QUEUE_H */
@@ -6,10 +6,11 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <sys/time.h>
+#include <time.h>
 
 #include "private.h"
 #include "uthread.h"
-#include "queue.h"
+#include "typed_queue.h"
 
 // All possible thread states.
 #define READY 0
@@ -17,157 +18,552 @@
 #define BLOCKED 2
 #define ZOMBIE 3
 
-// Queued threads to be dealt with.
-static queue_t ready_processes;
-static queue_t zombie_processes;
-static queue_t blocked_processes;
+// Threads ready to run. Blocked and zombie threads are only reachable through
+// the TID table (and whatever object they are waiting on). The queue is
+// specialized for TCB pointers, so that the scheduler's enqueues and dequeues
+// are inlined.
+DEFINE_QUEUE(ready_queue, struct uthread_tcb *)
 
-static struct uthread *running;
+static struct ready_queue ready_processes;
+
+static struct uthread_tcb *running;
+
+// Detached thread that exited, to be destroyed once another thread runs
+static struct uthread_tcb *reap_pending;
+
+// Original thread, when the library was started with uthread_run(): it only
+// gets the processor when no other thread is ready, and sleeps in the kernel.
+static struct uthread_tcb *idle_thread;
 
 // Initial conditions: preemption disabled, no instantiated threads.
 static int preempt_required = 0;
-static uthread_t num_processes = 0;
-
-struct uthread {
-    uthread_t tid;
-    int tid_blocking;
-    uthread_ctx_t *context;
+static size_t live_processes = 0;
+
+/* Size of a cache line, which the TCB layout is built around */
+#define CACHE_LINE_SIZE 64
+
+/*
+ * TCB layout: the fields the scheduler touches on every switch sit together in
+ * the first cache line, followed by the saved context (stored inline, on its
+ * own cache lines) and by the fields only used on rarer paths.
+ */
+struct uthread_tcb {
+    // Hot: state, switch mode, scheduling lane and cancellation checks
     int state;
-    void *stack;
-    int already_joined;
+    int canceled;
+    uthread_t tid;
+    struct uthread_ctx_shared *shared;
+
+    // Deadline lane: absolute deadline (0 if none)
+    uint64_t deadline;
+
+    // Node holding the thread in the ready queue, while it is in there
+    struct ready_queue_node *ready_node;
+
+    uthread_ctx_t context __attribute__((aligned(CACHE_LINE_SIZE)));
+
+    /*
+     * Cold: position in the deadline heap, wait cancellation, join state,
+     * memory, wait queue entry, cleanup handlers and stats
+     */
+    struct uthread_tcb_cold {
+        size_t heap_index;
+
+        // How to abort the current wait, if cancelled
+        uthread_wait_cancel_t wait_cancel;
+        void *wait_arg;
+        int wait_aborted;
+
+        struct uthread_tcb *joiner;
+        int already_joined;
+        int detached;
+        void *stack;
+        struct uthread_arena arena;
+        struct uthread_waiter waiter;
+        struct uthread_cleanup *cleanup;
+        int deadline_missed;
+        int worker;
+    } cold;
 };
 
-static int manage_thread_library(struct uthread **myThread, int is_main) {
-    *myThread = (struct uthread *)malloc(sizeof(struct uthread));
-    if (!*myThread) {
-        if (is_main) {
-            queue_destroy(zombie_processes);
-            queue_destroy(ready_processes);
+_Static_assert(offsetof(struct uthread_tcb, context) == CACHE_LINE_SIZE,
+               "hot TCB fields must fit in one cache line");
+
+/*
+ * Deadline lane
+ *
+ * Ready threads that have a deadline are kept in a min-heap keyed by deadline
+ * instead of the ready queue, and the earliest deadline is always scheduled
+ * first. To keep the ready queue from starving, one of its threads gets the
+ * processor after DEADLINE_STREAK_MAX consecutive deadline threads.
+ */
+#define DEADLINE_STREAK_MAX 8
+#define HEAP_NONE SIZE_MAX
+
+static struct uthread_tcb **deadline_heap;
+static size_t deadline_heap_len;
+static size_t deadline_heap_capacity;
+static size_t deadline_threads;
+static unsigned int deadline_streak;
+static struct uthread_deadline_stats deadline_stats;
+
+static void heap_set(size_t index, struct uthread_tcb *tcb)
+{
+    deadline_heap[index] = tcb;
+    tcb->cold.heap_index = index;
+}
+
+static void heap_sift_up(size_t index)
+{
+    struct uthread_tcb *tcb = deadline_heap[index];
+
+    while (index > 0) {
+        size_t parent = (index - 1) / 2;
+
+        if (deadline_heap[parent]->deadline <= tcb->deadline) {
+            break;
         }
+        heap_set(index, deadline_heap[parent]);
+        index = parent;
+    }
+    heap_set(index, tcb);
+}
 
-        return EXIT_FAILURE;
+static void heap_sift_down(size_t index)
+{
+    struct uthread_tcb *tcb = deadline_heap[index];
+
+    for (;;) {
+        size_t child = 2 * index + 1;
+
+        if (child >= deadline_heap_len) {
+            break;
+        }
+        if (child + 1 < deadline_heap_len &&
+            deadline_heap[child + 1]->deadline < deadline_heap[child]->deadline) {
+            child++;
+        }
+        if (tcb->deadline <= deadline_heap[child]->deadline) {
+            break;
+        }
+        heap_set(index, deadline_heap[child]);
+        index = child;
     }
+    heap_set(index, tcb);
+}
+
+/* Room for every deadline thread is reserved up front, so this cannot fail */
+static void heap_push(struct uthread_tcb *tcb)
+{
+    deadline_heap[deadline_heap_len] = tcb;
+    heap_sift_up(deadline_heap_len++);
+}
+
+static void heap_remove(struct uthread_tcb *tcb)
+{
+    size_t index = tcb->cold.heap_index;
+    struct uthread_tcb *last = deadline_heap[--deadline_heap_len];
+
+    tcb->cold.heap_index = HEAP_NONE;
+    if (last == tcb) {
+        return;
+    }
+    heap_set(index, last);
+    heap_sift_up(index);
+    heap_sift_down(last->cold.heap_index);
+}
+
+static uint64_t deadline_clock(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
 
-    (*myThread)->context = (ucontext_t *)malloc(sizeof(ucontext_t));
-    if (!(*myThread)->context) {
-        if (is_main) {
-            queue_destroy(ready_processes);
-            queue_destroy(zombie_processes);
+/*
+ * TID table
+ *
+ * A TID packs the index of the thread's slot in the table (low 32 bits) with
+ * the generation of that slot (high 32 bits). Slots of reaped threads are
+ * recycled through a free list, and their generation is bumped so that stale
+ * TIDs of previous occupants no longer match. The main thread always gets
+ * slot 0, generation 0, ie TID 0.
+ */
+#define TID_INDEX(tid) ((uint32_t)(tid))
+#define TID_GENERATION(tid) ((uint32_t)((tid) >> 32))
+#define TID_MAKE(index, generation) (((uthread_t)(generation) << 32) | (index))
+#define TID_NONE UINT32_MAX
+
+struct tid_slot {
+    struct uthread_tcb *tcb;
+    uint32_t generation;
+    uint32_t next_free;
+};
+
+static struct tid_slot *tid_table;
+static uint32_t tid_capacity;
+static uint32_t tid_used;
+static uint32_t tid_free = TID_NONE;
+
+static int tid_alloc(struct uthread_tcb *tcb)
+{
+    uint32_t index;
+
+    if (tid_free != TID_NONE) {
+        index = tid_free;
+        tid_free = tid_table[index].next_free;
+    } else {
+        if (tid_used == tid_capacity) {
+            uint32_t capacity = tid_capacity ? tid_capacity * 2 : 64;
+            struct tid_slot *table;
+
+            if (tid_capacity >= TID_NONE / 2) {
+                return -1;
+            }
+            table = realloc(tid_table, capacity * sizeof(*table));
+            if (!table) {
+                return -1;
+            }
+            tid_table = table;
+            tid_capacity = capacity;
         }
+        index = tid_used++;
+        tid_table[index].generation = 0;
+    }
+
+    tid_table[index].tcb = tcb;
+    tcb->tid = TID_MAKE(index, tid_table[index].generation);
+
+    return 0;
+}
+
+static void tid_release(uthread_t tid)
+{
+    struct tid_slot *slot = &tid_table[TID_INDEX(tid)];
+
+    slot->tcb = NULL;
+    slot->generation++;
+    slot->next_free = tid_free;
+    tid_free = TID_INDEX(tid);
+}
+
+static struct uthread_tcb *tid_lookup(uthread_t tid)
+{
+    struct tid_slot *slot;
+
+    if (TID_INDEX(tid) >= tid_used) {
+        return NULL;
+    }
+
+    slot = &tid_table[TID_INDEX(tid)];
+    if (slot->generation != TID_GENERATION(tid)) {
+        return NULL;
+    }
+
+    return slot->tcb;
+}
+
+static int manage_thread_library(struct uthread_tcb **myThread, int is_main) {
+    // The size of the TCB is a multiple of its alignment, as aligned_alloc() needs
+    *myThread = (struct uthread_tcb *)aligned_alloc(_Alignof(struct uthread_tcb),
+                                                    sizeof(struct uthread_tcb));
+    if (!*myThread) {
+        return EXIT_FAILURE;
+    }
+
+    if (tid_alloc(*myThread)) {
         free(*myThread);
 
         return EXIT_FAILURE;
     }
 
-    (*myThread)->tid = num_processes;
     (*myThread)->state = is_main ? RUNNING : READY;
-    (*myThread)->stack = NULL;
-    (*myThread)->tid_blocking = -1;
+    (*myThread)->cold.stack = NULL;
+    (*myThread)->shared = NULL;
+    (*myThread)->cold.joiner = NULL;
+    (*myThread)->cold.waiter.next = NULL;
+    (*myThread)->cold.waiter.prev = NULL;
+    (*myThread)->cold.waiter.addr = NULL;
+    (*myThread)->cold.waiter.uthread = *myThread;
+    uthread_arena_init(&(*myThread)->cold.arena, NULL, 0);
+    (*myThread)->cold.already_joined = 0;
+    (*myThread)->cold.detached = 0;
+    (*myThread)->canceled = 0;
+    (*myThread)->cold.wait_aborted = 0;
+    (*myThread)->cold.wait_cancel = NULL;
+    (*myThread)->cold.wait_arg = NULL;
+    (*myThread)->cold.cleanup = NULL;
+    (*myThread)->deadline = 0;
+    (*myThread)->cold.heap_index = HEAP_NONE;
+    (*myThread)->cold.deadline_missed = 0;
+    (*myThread)->cold.worker = 0;
 
     return EXIT_SUCCESS;
 }
 
 int uthread_start(int preempt)
 {
-    ready_processes = queue_create();
-    if (!ready_processes) {
-        return -1;
-    }
-
-    zombie_processes = queue_create();
-    if (!zombie_processes) {
-        queue_destroy(ready_processes);
-        return -1;
-    }
+    ready_queue_init(&ready_processes);
 
-    blocked_processes = queue_create();
-    if (!blocked_processes) {
-        queue_destroy(ready_processes);
-        queue_destroy(zombie_processes);
+    if (uthread_inbox_init()) {
         return -1;
     }
 
     if (manage_thread_library(&running, 1)) {
+        uthread_inbox_fini();
         return -1;
     }
 
     if (preempt) {
         preempt_required = preempt;
-        preempt_start();
+        preempt_start(preempt);
     }
 
     return 0;
 }
 
-int uthread_create(uthread_func_t func, void *arg)
+static void uthread_destroy(struct uthread_tcb *myThread)
 {
-    preempt_disable();
+    tid_release(myThread->tid);
+    uthread_arena_release(&myThread->cold.arena);
+    if (myThread->cold.stack) {
+        uthread_ctx_destroy_stack(myThread->cold.stack);
+    }
+    if (myThread->shared) {
+        uthread_ctx_destroy_shared(myThread->shared);
+        free(myThread->shared);
+    }
+    free(myThread);
+}
 
-    if (num_processes >= USHRT_MAX) {
-        return -1;
+/*
+ * Set up the execution context of new thread @myThread, either on a stack of
+ * its own or on the shared stack.
+ */
+static int uthread_init_context(struct uthread_tcb *myThread, uthread_func_t func,
+                                void *arg, int shared)
+{
+    size_t reserve;
+
+    if (shared) {
+        myThread->shared = malloc(sizeof(struct uthread_ctx_shared));
+        if (!myThread->shared) {
+            return -1;
+        }
+
+        if (uthread_ctx_init_shared(&myThread->context, myThread->shared, func, arg)) {
+            free(myThread->shared);
+            myThread->shared = NULL;
+            return -1;
+        }
+
+        return 0;
     }
 
-    num_processes++;
-    struct uthread *myThread = NULL;
-    if (manage_thread_library(&myThread, 0)) {
-        num_processes--;
+    myThread->cold.stack = uthread_ctx_alloc_stack();
+    if (!myThread->cold.stack) {
         return -1;
     }
 
-    myThread->stack = uthread_ctx_alloc_stack();
-    if (!myThread->stack) {
-        free(myThread->context);
-        free(myThread);
+    // The far end of the stack can serve as the first region of the arena
+    reserve = uthread_arena_stack_reserve();
+    uthread_arena_init(&myThread->cold.arena, reserve ? myThread->cold.stack : NULL, reserve);
+
+    return uthread_ctx_init(&myThread->context, myThread->cold.stack, reserve, func, arg);
+}
+
+static uthread_t uthread_spawn(uthread_func_t func, void *arg, int shared, int detached)
+{
+    preempt_disable();
+
+    struct uthread_tcb *myThread = NULL;
+    if (manage_thread_library(&myThread, 0)) {
+        preempt_enable();
         return -1;
     }
 
-    int context_init_error = uthread_ctx_init(myThread->context, myThread->stack, func);
-    if (context_init_error) {
-        uthread_ctx_destroy_stack(myThread->stack);
-        free(myThread->context);
-        free(myThread);
+    if (uthread_init_context(myThread, func, arg, shared)) {
+        uthread_destroy(myThread);
+        preempt_enable();
         return -1;
     }
 
-    preempt_disable();
-
-    if (queue_enqueue(ready_processes, (void *)myThread) == -1) {
-        uthread_ctx_destroy_stack(myThread->stack);
-        free(myThread->context);
-        free(myThread);
+    myThread->ready_node = ready_queue_enqueue_node(&ready_processes, myThread);
+    if (!myThread->ready_node) {
+        uthread_destroy(myThread);
+        preempt_enable();
         return -1;
     }
 
+    // A detached thread looks already joined to uthread_join()
+    myThread->cold.detached = detached;
+    myThread->cold.already_joined = detached;
+    live_processes++;
+    TRACE(TRACE_CREATE, running->tid, myThread->tid);
     preempt_enable();
 
     return myThread->tid;
 }
 
-static void uthread_destroy(struct uthread *myThread)
+uthread_t uthread_create(uthread_func_t func, void *arg)
 {
-    if (myThread->stack) {
-        uthread_ctx_destroy_stack(myThread->stack);
+    return uthread_spawn(func, arg, 0, 0);
+}
+
+uthread_t uthread_create_shared(uthread_func_t func, void *arg)
+{
+    return uthread_spawn(func, arg, 1, 0);
+}
+
+uthread_t uthread_create_detached(uthread_func_t func, void *arg)
+{
+    return uthread_spawn(func, arg, 0, 1);
+}
+
+/*
+ * Destroy the last detached thread that exited, once it is off its stack. Must
+ * be called with preemption disabled.
+ */
+static void uthread_reap(void)
+{
+    if (reap_pending) {
+        uthread_destroy(reap_pending);
+        reap_pending = NULL;
     }
-    free(myThread->context);
-    free(myThread);
 }
 
-void uthread_yield(void)
+/*
+ * Make @uthread ready to run, in the deadline lane if it has a deadline or in
+ * the ready queue otherwise. Must be called with preemption disabled.
+ */
+static void uthread_make_ready(struct uthread_tcb *uthread)
 {
-    preempt_disable();
+    uthread->state = READY;
+    if (uthread->deadline) {
+        heap_push(uthread);
+    } else {
+        uthread->ready_node = ready_queue_enqueue_node(&ready_processes, uthread);
+    }
+}
+
+/*
+ * Take the next thread to run out of the deadline lane or of the ready queue,
+ * or return NULL if no thread is ready. Must be called with preemption
+ * disabled.
+ */
+static struct uthread_tcb *uthread_pick_next(void)
+{
+    struct uthread_tcb *next;
+
+    if (deadline_heap_len > 0 &&
+        (deadline_streak < DEADLINE_STREAK_MAX || ready_queue_length(&ready_processes) == 0)) {
+        next = deadline_heap[0];
+        heap_remove(next);
+        deadline_streak++;
+
+        deadline_stats.dispatched++;
+        if (!next->cold.deadline_missed && deadline_clock() > next->deadline) {
+            next->cold.deadline_missed = 1;
+            deadline_stats.missed++;
+        }
+
+        return next;
+    }
+
+    deadline_streak = 0;
+    if (ready_queue_dequeue(&ready_processes, &next) == -1) {
+        return NULL;
+    }
 
+    return next;
+}
+
+/*
+ * Take ready thread @uthread out of whichever lane it is in, in constant time
+ * for the ready queue and logarithmic time for the deadline lane. Must be
+ * called with preemption disabled.
+ */
+static void uthread_ready_delete(struct uthread_tcb *uthread)
+{
+    if (uthread->cold.heap_index != HEAP_NONE) {
+        heap_remove(uthread);
+    } else {
+        ready_queue_remove(&ready_processes, uthread->ready_node);
+    }
+}
+
+/*
+ * Put the running thread back in line if it is still runnable. Must be called
+ * with preemption disabled.
+ */
+static void uthread_requeue_running(void)
+{
     if (running->state == RUNNING) {
-        running->state = READY;
-        queue_enqueue(ready_processes, (void *)running);
-    } else if (running->state == BLOCKED) {
-        queue_enqueue(blocked_processes, (void *)running);
+        uthread_make_ready(running);
     }
+}
 
-    struct uthread *current_process = running;
-    queue_dequeue(ready_processes, (void **)&running);
+/*
+ * Switch from the running thread to @next, which must already have been taken
+ * out of whichever queue it was in. Must be called with preemption disabled.
+ */
+static void uthread_switch(struct uthread_tcb *next)
+{
+    struct uthread_tcb *current_process = running;
+
+    running = next;
     running->state = RUNNING;
-    uthread_ctx_switch(current_process->context, running->context);
+    if (current_process != next) {
+        TRACE(TRACE_SWITCH, next->tid, current_process->tid);
+        preempt_quantum_start();
+        if (current_process->shared || next->shared) {
+            uthread_ctx_switch_shared(&current_process->context, current_process->shared,
+                                      &next->context, next->shared);
+        } else {
+            uthread_ctx_switch(&current_process->context, &next->context);
+        }
+        uthread_reap();
+    }
+}
+
+/*
+ * Pick the next thread to run and switch to it, the running thread having
+ * already been given its new state. Posted wakeups are received first. If no
+ * thread is ready at all, the idle thread gets the processor, or if there is
+ * none (or it is the one scheduling), the scheduler sleeps until a wakeup gets
+ * posted. Must be called with preemption disabled.
+ */
+static void uthread_schedule(void)
+{
+    struct uthread_tcb *next;
+
+    uthread_inbox_drain();
+    uthread_requeue_running();
+    while ((next = uthread_pick_next()) == NULL) {
+        if (idle_thread && idle_thread != running) {
+            next = idle_thread;
+            break;
+        }
+        uthread_inbox_wait();
+        uthread_inbox_drain();
+    }
+    uthread_switch(next);
+}
 
+void uthread_yield(void)
+{
+    preempt_disable();
+    uthread_schedule();
+    preempt_enable();
+
+    uthread_testcancel();
+}
+
+void uthread_preempt(void)
+{
+    preempt_disable();
+    uthread_schedule();
     preempt_enable();
 }
 
@@ -176,42 +572,212 @@ uthread_t uthread_self(void)
     return running->tid;
 }
 
-static int find_tid(queue_t q, void *data, void *arg)
+struct uthread_tcb *uthread_current(void)
 {
-    struct uthread *a = (struct uthread *)data;
-    uthread_t match = (uthread_t)(long)arg;
-    (void)q;
+    return running;
+}
 
-    if (a->tid == match)
-        return 1;
+struct uthread_waiter *uthread_current_waiter(void)
+{
+    return &running->cold.waiter;
+}
 
-    return 0;
+struct uthread_arena *uthread_current_arena(void)
+{
+    return &running->cold.arena;
 }
 
-int uthread_stop(void)
+void uthread_set_worker(void)
 {
-    if (running->tid != 0) {
+    running->cold.worker = 1;
+}
+
+int uthread_is_worker(void)
+{
+    return running->cold.worker;
+}
+
+int uthread_yield_to(uthread_t tid)
+{
+    struct uthread_tcb *target;
+
+    preempt_disable();
+
+    target = tid_lookup(tid);
+    if (!target || target->state != READY) {
+        preempt_enable();
         return -1;
     }
 
-    if (queue_length(ready_processes) != 0 && queue_length(zombie_processes) != 0) {
+    uthread_ready_delete(target);
+    uthread_inbox_drain();
+    uthread_requeue_running();
+    uthread_switch(target);
+
+    preempt_enable();
+
+    return 0;
+}
+
+void uthread_block(void)
+{
+    running->state = BLOCKED;
+    uthread_schedule();
+}
+
+int uthread_block_cancelable(uthread_wait_cancel_t cancel, void *arg)
+{
+    if (running->canceled) {
+        cancel(running, arg);
         return -1;
     }
 
-    while (queue_length(zombie_processes) > 0) {
-        struct uthread *myThread;
+    running->cold.wait_cancel = cancel;
+    running->cold.wait_arg = arg;
+    running->cold.wait_aborted = 0;
+    uthread_block();
+    running->cold.wait_cancel = NULL;
+
+    return running->cold.wait_aborted ? -1 : 0;
+}
+
+void uthread_unblock(struct uthread_tcb *uthread)
+{
+    if (uthread->state == BLOCKED) {
+        TRACE(TRACE_UNBLOCK, uthread->tid, running->tid);
+        uthread_make_ready(uthread);
+    }
+}
+
+void uthread_unblock_handoff(struct uthread_tcb *uthread)
+{
+    if (uthread->state == BLOCKED) {
+        TRACE(TRACE_UNBLOCK, uthread->tid, running->tid);
+        uthread_requeue_running();
+        uthread_switch(uthread);
+    }
+}
+
+int uthread_set_deadline(uthread_t tid, uint64_t deadline)
+{
+    struct uthread_tcb *uthread;
 
-        preempt_disable();
-        queue_dequeue(zombie_processes, (void **)&myThread);
+    preempt_disable();
+
+    uthread = tid_lookup(tid);
+    if (!uthread || uthread->state == ZOMBIE) {
         preempt_enable();
+        return -1;
+    }
 
-        uthread_destroy(myThread);
+    // Reserve a heap slot for each deadline thread, so that pushing never fails
+    if (deadline && !uthread->deadline) {
+        if (deadline_threads == deadline_heap_capacity) {
+            size_t capacity = deadline_heap_capacity ? deadline_heap_capacity * 2 : 16;
+            struct uthread_tcb **heap = realloc(deadline_heap, capacity * sizeof(*heap));
+
+            if (!heap) {
+                preempt_enable();
+                return -1;
+            }
+            deadline_heap = heap;
+            deadline_heap_capacity = capacity;
+        }
+        deadline_threads++;
+    } else if (!deadline && uthread->deadline) {
+        deadline_threads--;
+    }
+
+    // A ready thread has to move to the lane matching its new deadline
+    if (uthread->state == READY) {
+        uthread_ready_delete(uthread);
+    }
+
+    uthread->deadline = deadline;
+    uthread->cold.deadline_missed = 0;
+
+    if (uthread->state == READY) {
+        uthread_make_ready(uthread);
+    }
+
+    preempt_enable();
+
+    return 0;
+}
+
+void uthread_get_deadline_stats(struct uthread_deadline_stats *stats)
+{
+    preempt_disable();
+    *stats = deadline_stats;
+    preempt_enable();
+}
+
+int uthread_run(bool preempt, uthread_func_t func, void *arg)
+{
+    if (uthread_start(preempt ? UTHREAD_PREEMPT_SIGNAL : UTHREAD_PREEMPT_NONE)) {
+        return -1;
+    }
+
+    if (uthread_create(func, arg) == (uthread_t)-1) {
+        uthread_stop();
+        return -1;
+    }
+
+    /*
+     * Idle loop: the idle thread is never put back in line, so it only runs
+     * again once no other thread is ready. It then sleeps in the kernel until
+     * a wakeup gets posted, or returns once the last thread has exited.
+     */
+    preempt_disable();
+    idle_thread = running;
+    while (live_processes > 0) {
+        running->state = BLOCKED;
+        uthread_schedule();
+    }
+    idle_thread = NULL;
+    preempt_enable();
+
+    return uthread_stop();
+}
+
+int uthread_stop(void)
+{
+    uint32_t index;
+
+    if (running->tid != 0) {
+        return -1;
     }
 
-    queue_destroy(ready_processes);
-    queue_destroy(zombie_processes);
-    queue_destroy(blocked_processes);
+    if (live_processes != 0) {
+        return -1;
+    }
+
+    // Apply the pending wakeups, and reap the threads that were never joined
+    preempt_disable();
+    uthread_inbox_drain();
+    uthread_reap();
+    for (index = 1; index < tid_used; index++) {
+        if (tid_table[index].tcb) {
+            uthread_destroy(tid_table[index].tcb);
+        }
+    }
+    preempt_enable();
+
+    ready_queue_fini(&ready_processes);
     uthread_destroy(running);
+    uthread_inbox_fini();
+
+    free(deadline_heap);
+    deadline_heap = NULL;
+    deadline_heap_len = 0;
+    deadline_heap_capacity = 0;
+    deadline_threads = 0;
+
+    free(tid_table);
+    tid_table = NULL;
+    tid_capacity = 0;
+    tid_used = 0;
+    tid_free = TID_NONE;
 
     if (preempt_required) {
         preempt_stop();
@@ -220,44 +786,132 @@ int uthread_stop(void)
     return 0;
 }
 
-void uthread_exit(void)
+int uthread_cancel(uthread_t tid)
 {
+    struct uthread_tcb *uthread;
+
     preempt_disable();
-    if (running->tid_blocking != -1) {
-        struct uthread *blocked = NULL;
-        queue_iterate(blocked_processes, find_tid, (void *)(size_t)running->tid_blocking, (void **)&blocked);
 
-        blocked->state = READY;
-        queue_delete(blocked_processes, blocked);
-        queue_enqueue(ready_processes, (void *)blocked);
+    uthread = tid_lookup(tid);
+    if (tid == 0 || !uthread || uthread->state == ZOMBIE) {
+        preempt_enable();
+        return -1;
+    }
+
+    uthread->canceled = 1;
+
+    // Pull the thread out of whatever it is waiting on, so it can act on it
+    if (uthread->state == BLOCKED && uthread->cold.wait_cancel) {
+        uthread->cold.wait_cancel(uthread, uthread->cold.wait_arg);
+        uthread->cold.wait_cancel = NULL;
+        uthread->cold.wait_aborted = 1;
+        uthread_unblock(uthread);
+    }
+
+    preempt_enable();
+
+    return 0;
+}
+
+void uthread_testcancel(void)
+{
+    struct uthread_cleanup *cleanup;
+
+    if (!running->canceled) {
+        return;
+    }
+
+    // Handlers may block: only a new request should interrupt them
+    running->canceled = 0;
+    while ((cleanup = running->cold.cleanup) != NULL) {
+        running->cold.cleanup = cleanup->prev;
+        cleanup->func(cleanup->arg);
+    }
+
+    uthread_exit();
+}
+
+void uthread_cleanup_register(struct uthread_cleanup *cleanup)
+{
+    cleanup->prev = running->cold.cleanup;
+    running->cold.cleanup = cleanup;
+}
+
+void uthread_cleanup_unregister(struct uthread_cleanup *cleanup, int execute)
+{
+    running->cold.cleanup = cleanup->prev;
+    if (execute) {
+        cleanup->func(cleanup->arg);
     }
+}
 
+void uthread_exit(void)
+{
+    preempt_disable();
+    if (running->cold.joiner) {
+        uthread_unblock(running->cold.joiner);
+    }
+
+    TRACE(TRACE_EXIT, running->tid, 0);
+    uthread_arena_release(&running->cold.arena);
     running->state = ZOMBIE;
-    queue_enqueue(zombie_processes, (void *)running);
+    live_processes--;
+    if (running->deadline) {
+        running->deadline = 0;
+        deadline_threads--;
+    }
 
-    uthread_yield();
+    // Nobody will join a detached thread: have it destroyed after switching
+    if (running->cold.detached) {
+        uthread_reap();
+        reap_pending = running;
+    }
+
+    uthread_schedule();
+}
+
+/* Abort a join, when the joiner gets cancelled */
+static void join_cancel(struct uthread_tcb *uthread, void *arg)
+{
+    struct uthread_tcb *tbj = (struct uthread_tcb *)arg;
+    (void)uthread;
+
+    tbj->cold.joiner = NULL;
+    tbj->cold.already_joined = 0;
 }
 
 int uthread_join(uthread_t tid, int *retval)
 {
     (void)retval;
 
-    struct uthread *tbj = NULL;
+    struct uthread_tcb *tbj = NULL;
 
-    queue_iterate(ready_processes, find_tid, (void *)(size_t)tid, (void **)&tbj);
-    queue_iterate(zombie_processes, find_tid, (void *)(size_t)tid, (void **)&tbj);
+    uthread_testcancel();
 
-    if (tid == 0 || running->tid == tid || tbj == NULL || tbj->already_joined) {
+    preempt_disable();
+
+    tbj = tid_lookup(tid);
+
+    if (tid == 0 || running->tid == tid || tbj == NULL || tbj->cold.already_joined) {
+        preempt_enable();
         return -1;
     }
 
-    tbj->already_joined = 1;
+    tbj->cold.already_joined = 1;
 
-    if (tbj->state == READY) {
-        running->state = BLOCKED;
-        tbj->tid_blocking = (int)running->tid;
-        uthread_yield();
+    if (tbj->state != ZOMBIE) {
+        tbj->cold.joiner = running;
+        TRACE(TRACE_BLOCK, running->tid, tid);
+        if (uthread_block_cancelable(join_cancel, tbj)) {
+            preempt_enable();
+            uthread_testcancel();
+        }
     }
 
+    // The joined thread is done and switched out for good: reap it
+    uthread_destroy(tbj);
+
+    preempt_enable();
+
     return EXIT_SUCCESS;
 }
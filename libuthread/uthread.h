@@ -2,6 +2,16 @@
 #define _UTHREAD_H
 
 #include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * uthread_t - Thread identifier type
+ *
+ * TIDs of finished threads are recycled once these threads have been joined,
+ * but each TID embeds a generation counter, so that a stale TID does not refer
+ * to the new thread reusing its slot.
+ */
+typedef uint64_t uthread_t;
 
 /*
  * uthread_func_t - Thread function type
@@ -19,13 +29,57 @@ typedef void (*uthread_func_t)(void *arg);
  * thread. It starts the multithreading scheduling library, and becomes the
  * "idle" thread. It returns once all the threads have finished running.
  *
- * If @preempt is `true`, then preemptive scheduling is enabled.
+ * The idle thread only runs when no other thread is ready to run, for instance
+ * when all of them wait for a wakeup posted from another kernel thread (see
+ * sem_up_remote()). It then sleeps in the kernel until such a wakeup arrives,
+ * so that an idle scheduler uses no CPU.
+ *
+ * If @preempt is `true`, then preemptive scheduling is enabled, with
+ * UTHREAD_PREEMPT_SIGNAL.
  *
  * Return: 0 in case of success, -1 in case of failure (e.g., memory allocation,
  * context creation).
  */
 int uthread_run(bool preempt, uthread_func_t func, void *arg);
 
+/*
+ * Preemption modes
+ *
+ * UTHREAD_PREEMPT_NONE: threads only give the processor away voluntarily.
+ *
+ * UTHREAD_PREEMPT_SIGNAL: a 100 Hz virtual alarm forcefully yields the running
+ * thread, wherever it is (including in the middle of non reentrant library
+ * functions such as malloc() or printf()).
+ *
+ * UTHREAD_PREEMPT_SAFEPOINT: no signal is used. The running thread yields from
+ * uthread_maybe_yield() once it has used up its 10 ms time slice, which makes
+ * preemption deterministic and safe around any library call.
+ */
+#define UTHREAD_PREEMPT_NONE		0
+#define UTHREAD_PREEMPT_SIGNAL		1
+#define UTHREAD_PREEMPT_SAFEPOINT	2
+
+/*
+ * uthread_start - Start the multithreading library
+ * @preempt: Preemption mode, one of the UTHREAD_PREEMPT_* values
+ *
+ * This function should only be called by the process' original execution
+ * thread, which becomes the thread of TID 0.
+ *
+ * Return: 0 in case of success, -1 in case of failure (e.g., memory allocation)
+ */
+int uthread_start(int preempt);
+
+/*
+ * uthread_stop - Stop the multithreading library
+ *
+ * This function should only be called by the thread of TID 0, once all the
+ * other threads have finished running.
+ *
+ * Return: 0 in case of success, -1 in case of failure
+ */
+int uthread_stop(void);
+
 /*
  * uthread_create - Create a new thread
  * @func: Function to be executed by the thread
@@ -34,19 +88,137 @@ int uthread_run(bool preempt, uthread_func_t func, void *arg);
  * This function creates a new thread running the function @func to which
  * argument @arg is passed.
  *
- * Return: 0 in case of success, -1 in case of failure (e.g., memory allocation,
- * context creation).
+ * Return: TID of the new thread in case of success, (uthread_t)-1 in case of
+ * failure (e.g., memory allocation, context creation).
+ */
+uthread_t uthread_create(uthread_func_t func, void *arg);
+
+/*
+ * uthread_create_shared - Create a new thread running on the shared stack
+ * @func: Function to be executed by the thread
+ * @arg: Argument to be passed to the thread
+ *
+ * This function creates a new thread running the function @func to which
+ * argument @arg is passed, like uthread_create(). Instead of getting a stack of
+ * its own, the thread runs on a large stack shared with all the other threads
+ * created by this function. When it is switched out for another shared-stack
+ * thread, only the part of the stack it actually uses is copied aside, so an
+ * idle thread costs about as much memory as its live stack depth.
+ *
+ * Switching between two shared-stack threads costs a copy of their stacks.
+ * Also, the local variables of a shared-stack thread are only valid while that
+ * thread owns the shared stack: their address must not be given to other
+ * threads (e.g. a semaphore allocated on the stack to wait for a reply).
+ *
+ * Return: TID of the new thread in case of success, (uthread_t)-1 in case of
+ * failure (e.g., memory allocation, context creation).
  */
-int uthread_create(uthread_func_t func, void *arg);
+uthread_t uthread_create_shared(uthread_func_t func, void *arg);
 
 /*
  * uthread_yield - Yield execution
  *
  * This function is to be called from the currently active and running thread in
  * order to yield for other threads to execute.
+ *
+ * This function is a cancellation point (see uthread_cancel()).
  */
 void uthread_yield(void);
 
+/*
+ * uthread_yield_to - Yield execution to a specific thread
+ * @tid: TID of the thread to run next
+ *
+ * This function is to be called from the currently active and running thread in
+ * order to hand the processor directly to thread @tid, without going through
+ * the other threads waiting in the ready queue. The calling thread is put back
+ * at the end of the ready queue. Thread @tid is taken out of the ready queue in
+ * constant time, however many threads are ready.
+ *
+ * Return: -1 if @tid is not a thread ready to run, 0 otherwise (once the caller
+ * is scheduled again).
+ */
+int uthread_yield_to(uthread_t tid);
+
+/*
+ * uthread_set_deadline - Put a thread in the deadline lane
+ * @tid: TID of the thread
+ * @deadline: Absolute deadline, in nanoseconds of CLOCK_MONOTONIC, or 0 to
+ *	move the thread back to the regular ready queue
+ *
+ * Whenever they are ready to run, threads with a deadline are scheduled before
+ * the threads of the regular ready queue, earliest deadline first. To avoid
+ * starving the regular ready queue, one of its threads still gets to run after
+ * every 8 consecutive deadline threads.
+ *
+ * A thread typically sets a new deadline for itself (uthread_self()) whenever
+ * it starts processing a new request.
+ *
+ * Return: -1 if thread @tid cannot be found or has already exited, or in case
+ * of memory allocation error. 0 otherwise.
+ */
+int uthread_set_deadline(uthread_t tid, uint64_t deadline);
+
+/*
+ * uthread_deadline_stats - Deadline lane counters
+ * @dispatched: Number of times a deadline thread was scheduled
+ * @missed: Number of deadlines that had already passed when their thread was
+ *	scheduled (each deadline is counted at most once)
+ */
+struct uthread_deadline_stats {
+	uint64_t dispatched;
+	uint64_t missed;
+};
+
+/*
+ * uthread_get_deadline_stats - Get deadline lane counters
+ * @stats: Address of the structure receiving the counters
+ */
+void uthread_get_deadline_stats(struct uthread_deadline_stats *stats);
+
+/*
+ * uthread_safepoint - Slow path of uthread_maybe_yield()
+ *
+ * Not meant to be called directly.
+ */
+void uthread_safepoint(void);
+
+/*
+ * Safe-points left before uthread_maybe_yield() takes its slow path, in the
+ * calling kernel thread
+ */
+extern _Thread_local int uthread_safepoint_countdown;
+
+/*
+ * uthread_maybe_yield - Preemption safe-point
+ *
+ * This function is meant to be called regularly from long-running code, such
+ * as at each iteration of a loop. With UTHREAD_PREEMPT_SAFEPOINT preemption,
+ * it yields if the running thread has used up its time slice. Most calls only
+ * decrement a counter: the clock is read every few hundred calls at most, and
+ * more often when calls are far apart, so that the slice is overrun by no more
+ * than about a millisecond.
+ *
+ * Calls made from other kernel threads (e.g. pthreads running code built with
+ * safe-point hooks) never yield.
+ *
+ * Alternatively, building the library with `make SAFEPOINTS=1` and the
+ * application code with `-finstrument-functions` places a safe-point at every
+ * function entry of the application.
+ */
+static inline void uthread_maybe_yield(void)
+{
+	if (__builtin_expect(--uthread_safepoint_countdown <= 0, 0))
+		uthread_safepoint();
+}
+
+/*
+ * uthread_self - Get thread identifier
+ *
+ * Return: The TID of the currently running thread
+ */
+uthread_t uthread_self(void);
+
 /*
  * uthread_exit - Exit from currently running thread
  *
@@ -57,4 +229,102 @@ void uthread_yield(void);
  */
 void uthread_exit(void);
 
-#endif /* _THREAD_H */
+/*
+ * uthread_join - Join a thread
+ * @tid: TID of the thread to join
+ * @retval: Address of an integer that will receive the return value
+ *
+ * This function blocks the calling thread until thread @tid has finished
+ * running, and then releases the resources of thread @tid, including its TID.
+ * A thread can only be joined once.
+ *
+ * Return: -1 if @tid is 0 (the main thread), if @tid is the TID of the calling
+ * thread, if thread @tid cannot be found (including if @tid is the stale TID of
+ * a thread which has already been joined), or if thread @tid is already being
+ * joined. 0 otherwise.
+ *
+ * This function is a cancellation point (see uthread_cancel()).
+ */
+int uthread_join(uthread_t tid, int *retval);
+
+/*
+ * uthread_cancel - Request the cancellation of a thread
+ * @tid: TID of the thread to cancel
+ *
+ * Cancellation is cooperative: thread @tid exits the next time it reaches a
+ * cancellation point, ie when calling uthread_yield(), uthread_join(),
+ * uthread_testcancel(), sem_down() or uthread_park(). If it is already blocked
+ * in one of these functions, it is woken up right away. Before exiting, it runs
+ * the cleanup handlers it registered with uthread_cleanup_push(), most recent
+ * first.
+ *
+ * Preemption never acts as a cancellation point.
+ *
+ * Return: -1 if @tid is 0 (the main thread), or if thread @tid cannot be found
+ * or has already exited. 0 otherwise.
+ */
+int uthread_cancel(uthread_t tid);
+
+/*
+ * uthread_testcancel - Cancellation point
+ *
+ * If a cancellation of the calling thread was requested, run its cleanup
+ * handlers and exit. Otherwise, return right away.
+ */
+void uthread_testcancel(void);
+
+/*
+ * uthread_cleanup - Cleanup handler record, see uthread_cleanup_push()
+ */
+struct uthread_cleanup {
+	void (*func)(void *arg);
+	void *arg;
+	struct uthread_cleanup *prev;
+};
+
+/*
+ * uthread_cleanup_register - Push a cleanup handler record
+ * @cleanup: Record to push, which must stay valid until it is unregistered
+ *
+ * Push @cleanup on the calling thread's stack of cleanup handlers. Meant to be
+ * used through uthread_cleanup_push(), which provides the record.
+ */
+void uthread_cleanup_register(struct uthread_cleanup *cleanup);
+
+/*
+ * uthread_cleanup_unregister - Pop a cleanup handler record
+ * @cleanup: Record to pop, which must be the last one pushed
+ * @execute: Whether to call the handler
+ *
+ * Pop @cleanup from the calling thread's stack of cleanup handlers, and call
+ * its handler if @execute is non-zero. Meant to be used through
+ * uthread_cleanup_pop().
+ */
+void uthread_cleanup_unregister(struct uthread_cleanup *cleanup, int execute);
+
+/*
+ * uthread_cleanup_push - Register a cleanup handler
+ * @func: Function to call if the thread gets cancelled
+ * @arg: Argument to pass to @func
+ *
+ * Register @func to be called with @arg if the calling thread gets cancelled
+ * before the matching uthread_cleanup_pop(), which must be called in the same
+ * function and at the same block level. No memory is allocated.
+ */
+#define uthread_cleanup_push(func, arg)					\
+do {									\
+	struct uthread_cleanup __uthread_cleanup = { (func), (arg), NULL };	\
+	uthread_cleanup_register(&__uthread_cleanup);
+
+/*
+ * uthread_cleanup_pop - Unregister a cleanup handler
+ * @execute: Whether to call the handler
+ *
+ * Unregister the cleanup handler registered by the matching
+ * uthread_cleanup_push(), and call it if @execute is non-zero.
+ */
+#define uthread_cleanup_pop(execute)					\
+	uthread_cleanup_unregister(&__uthread_cleanup, (execute));	\
+} while (0)
+
+#endif /* _UTHREAD_H */